@@ -24,30 +24,73 @@ This version aspires to give a result for n=6 before the death of the sun,
 but whether it can or not is yet to be confirmed.
 
 Author: Greg Egan
-Version: 2.13
-Last Updated: 6 May 2019
+Version: 2.16
+Last Updated: 17 October 2026
 
 Usage:
 
-	ChaffinMethod n [oneExample] [noRepeats]
+	ChaffinMethod n [oneExample] [noRepeats] [noMirrors] [history] [threads N] [speculate K] [transpositions T] [knownTable F] [startW S] [lastW W] [checkpoint M]
 
 Computes strings (starting with 123...n) that contain the maximum possible number of distinct permutations on n symbols while wasting w
 characters, for all values of w from 1 up to the point where all permutations are visited (i.e. these strings become
 superpermutations).  The default is to find ALL such strings; if the "oneExample" option is specified, then only a single
 example is found.  The "noRepeats" option explicitly rules out strings that contain any permutation more than once.
+The "noMirrors" option halves the list of all examples, by only searching for one string from each pair that are mirror images
+of each other (the reversed string, relabelled to start with 123...n); the other strings are restored when the lists are read back.
+The "history" option, which needs "oneExample", tries first the digits that led to better strings earlier in the search.
+The "threads N" option spreads each search across N worker threads, by splitting the search tree at a shallow depth into
+subtrees that the workers take from their own queues, or steal from each other's queues once their own are empty.
+The "speculate K" option searches for K values of max_perm at once, in separate processes, rather than trying them one at a time.
+The "transpositions T" option keeps a T-megabyte table of states (the set of permutations visited and the last n-1 digits)
+from which the search has already been found to be hopeless, so it can skip them if they are reached again by another route.
+The "knownTable F" option reads the maximum number of permutations for each w from a file F in the same form as the
+ChaffinMethodMaxPerms_<n>.txt files, and starts each search at that value; "startW S" also takes the values in F as exact for
+every w below S, and starts searching at w=S.
+The "lastW W" option stops the program once the search for w=W is done, rather than running on to a superpermutation.
 
 The strings for each value of w are written to files of the form:
 
 Chaffin_<n>_W_<w>.txt
 
-If the program is halted for some reason, when it is run again it will read back any files it finds with names of this form,
+and in packed form (with a short header, and 3 bits per digit) to files of the form:
+
+Chaffin_<n>_W_<w>.bin
+
+If the program is halted for some reason, when it is run again it will read back any files it finds with names of these forms,
 and restart computations for the w value of the last such file that it finds.
+
+In addition, every M minutes (default 10; "checkpoint 0" turns this off) the program pauses all threads and writes the exact
+position of the search in progress to a checkpoint file:
+
+Chaffin_<n>_CP.bin
+
+If this file is present when the program starts, the search for that w value resumes from the node where the checkpoint was
+taken, rather than from the beginning.  The file is deleted when the search for that w value is complete.
+
+For n >= 7, the tables of possible next digits are written to a file:
+
+Chaffin_<n>_Tables.bin
+
+and later runs map that file into memory, rather than building the tables again.
 */
 
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 //	Constants
 //	---------
@@ -59,33 +102,169 @@ and restart computations for the w value of the last such file that it finds.
 
 //	Smallest and largest values of n accepted
 
-//	(Note that if we went higher than n=7, DBITS would need to increase, and we would also need to change some variables
-//	from 32-bit to 64-bit ints. However, at this point it seems extremely unlikely that it would ever be practical to
-//	run this code with n=8.)
+//	(The tables we look up as we append each digit are indexed densely, by the rank of a permutation or the index of a
+//	sequence of n-1 digits, so their size grows with the number of sequences we can actually encounter, rather than with
+//	a power of 2 for each digit.  For n=8, there are 941,192 such sequences.)
 
 #define MIN_N 3
-#define MAX_N 7
+#define MAX_N 8
 
-//	Number of bits allowed for each digit in integer representation of permutations
+//	Number of bits allowed for each digit in packed strings and tries; for n=8, the digit 8 is stored as 0, which is
+//	never a digit itself
 
 #define DBITS 3
+#define PACK_DIGIT(d) ((d)&((1<<DBITS)-1))
+#define UNPACK_DIGIT(b) ((b) ? (b) : (1<<DBITS))
+
+//	Largest number of worker threads accepted by the "threads" option
+
+#define MAX_THREADS 256
+
+//	Largest number of searches with different values of max_perm accepted by the "speculate" option
+
+#define MAX_LANES 16
+
+//	Default size of the transposition table in megabytes, and the largest allowed; "transpositions M" turns the table on.
+//	Each bucket of TT_BUCKET entries fills one 64-byte cache line.
+
+#define DEFAULT_TT_MEGABYTES 0
+#define MAX_TT_MEGABYTES (1<<16)
+#define TT_BUCKET 4
+
+//	We only use the transposition table at nodes where no more than this many characters have been wasted so far; the
+//	subtrees below the other nodes are too small to repay the cache miss of looking them up.
+
+#define TT_MAX_WASTED 8
+
+//	Number of bits in the index of the history table used by the "history" option, which is hashed from the depth and the
+//	last n-1 digits
+
+#define HISTORY_BITS 20
+
+//	When searching with multiple threads, we keep splitting the tree one level deeper until we have at least this many
+//	subtrees for each thread, or we reach the maximum number of levels we are willing to split
+
+#define TASKS_PER_THREAD 32
+#define MAX_SPLIT_LEVELS 16
+
+//	Default number of minutes between checkpoints, and the number of nodes each thread searches between checks of the clock
+//	(which must be a power of 2)
+
+#define DEFAULT_CHECKPOINT_MINUTES 10
+#define CLOCK_CHECK_NODES (1<<20)
+
+//	Identifying string and version number for checkpoint files; the version must change whenever the format does
+
+#define CHECKPOINT_MAGIC "ChaffinCP"
+#define CHECKPOINT_VERSION 6
+
+//	Identifying string and version number for packed files of best strings
+
+#define BEST_STRINGS_MAGIC "ChaffinBS"
+#define BEST_STRINGS_VERSION 1
+
+//	Identifying string and version number for files holding the tables of next digits, which we keep for n >= TABLES_MIN_N,
+//	where they take long enough to build that it is worth mapping a copy from a file instead.  The version should be
+//	increased whenever the contents of the tables, or the way we index them, are changed.
+
+#define TABLES_MAGIC "ChaffinTB"
+#define TABLES_VERSION 1
+#define TABLES_MIN_N 7
 
 //	Macros
 //	------
 
 #define CHECK_MEM(p) if ((p)==NULL) {printf("Insufficient memory\n"); exit(EXIT_FAILURE);};
 
+//	Functions that make up the search kernel, which are always inlined into a separate copy of the search for each value of n
+
+#ifdef __GNUC__
+	#define KERNEL static inline __attribute__((always_inline))
+#else
+	#define KERNEL static inline
+#endif
+
+//	Flags for visited permutations are packed into a bitset, indexed by the rank of each permutation
+
+#define VISITED(v,r) (((v)[(r)>>6]>>((r)&63))&1)
+#define SET_VISITED(v,r) ((v)[(r)>>6] |= ((uint64_t)1)<<((r)&63))
+#define CLEAR_VISITED(v,r) ((v)[(r)>>6] &= ~(((uint64_t)1)<<((r)&63)))
+
+//	Update a thread's 1-cycle information when we visit or unvisit the permutation with rank r.
+//
+//	If the 1-cycle's count of unvisited permutations goes from c to c-1, one fewer 1-cycle has at least c unvisited, and we
+//	subtract cycleDelta[c][b] from the total for the 1-cycles with at least b unvisited; the sorted list of counts changes in
+//	just one place, the boundary between the entries for c and c-1.
+
+#define VISIT_CYCLE(ss,r) \
+	{ \
+	int c_ = (ss)->oneCycleCounts[oneCycleIndices[r]]--; \
+	(ss)->oneCycleSorted[--(ss)->oneCycleCum[c_]] = c_-1; \
+	for (int b_=0;b_<=n;b_++) (ss)->oneCycleSum[b_] -= cycleDelta[c_][b_]; \
+	if (parityTier) \
+		{ \
+		int q_ = cycleParity[oneCycleIndices[r]]; \
+		(ss)->paritySorted[q_][--(ss)->parityCum[q_][c_]] = c_-1; \
+		for (int b_=0;b_<=n;b_++) (ss)->paritySum[q_][b_] -= cycleDelta[c_][b_]; \
+		}; \
+	};
+	
+#define UNVISIT_CYCLE(ss,r) \
+	{ \
+	int c_ = ++(ss)->oneCycleCounts[oneCycleIndices[r]]; \
+	(ss)->oneCycleSorted[(ss)->oneCycleCum[c_]++] = c_; \
+	for (int b_=0;b_<=n;b_++) (ss)->oneCycleSum[b_] += cycleDelta[c_][b_]; \
+	if (parityTier) \
+		{ \
+		int q_ = cycleParity[oneCycleIndices[r]]; \
+		(ss)->paritySorted[q_][(ss)->parityCum[q_][c_]++] = c_; \
+		for (int b_=0;b_<=n;b_++) (ss)->paritySum[q_][b_] += cycleDelta[c_][b_]; \
+		}; \
+	};
+
+//	Strings are packed into bytes, DBITS bits per digit, with the first digit in the lowest bits of the first byte;
+//	each string in a list starts on a new byte, so the number of bytes for a string of a given length is:
+
+#define PACKED_SIZE(len) ((((long int)(len))*DBITS+7)/8)
+
+//	Lists of packed strings are followed by this many bytes of padding, so we can read digits from them 4 bytes at a time
+
+#define PACKED_PADDING 4
+
+//	Get 4 bytes from packed digits, with the first byte in the lowest bits
+
+#define PACKED_WORD(p) ((uint64_t)((p)[0] | ((p)[1]<<8) | ((p)[2]<<16) | ((uint32_t)(p)[3]<<24)))
+
 //	If GET_OCP_DATA is TRUE, we gather data on where 1-cycle tracking first starts pruning
 //	If GET_OCP_DATA is FALSE, we USE data gathered when it was TRUE that has been recorded in the array ocpThreshold[]
 
 #define GET_OCP_DATA FALSE
 
+//	If KEEP_STRINGS is TRUE, we keep a copy in memory of every string we write to the output file, so that at the end
+//	of the search for each w we already have the list of best strings.
+//	If KEEP_STRINGS is FALSE, we read the list back from the output file instead.
+
+#define KEEP_STRINGS TRUE
+
+//	If SEARCH_STATS is TRUE, we count the nodes entered at each depth of the tree, the branches cut off there by each
+//	of the bounds and by falling back, and the times we switch to following the best strings for a smaller w, and write
+//	the counts to a file at the end of the search for each w.  This can be set from the compiler's command line,
+//	and "make stats" builds the program this way as ChaffinMethodStats.
+
+#ifndef SEARCH_STATS
+#define SEARCH_STATS FALSE
+#endif
+
+//	Size of the buffer for the output file
+
+#define OUTPUT_BUFFER_SIZE (1<<20)
+
 #if GET_OCP_DATA
 
 	#define PRINT_OCP_DATA printf("*** 1-cycle pruning first effective for lowestW=%d ***\n",lowestW);
 
 	#define MONITOR_OCP \
-		prunedOCP++; \
+		ss->prunedOCP++; \
 		if (tot_bl<lowestW) \
 			{ \
 			lowestW=tot_bl; \
@@ -94,7 +273,34 @@ and restart computations for the w value of the last such file that it finds.
 
 #else
 
-	#define MONITOR_OCP prunedOCP++;
+	#define MONITOR_OCP ss->prunedOCP++;
+	
+#endif
+
+//	The kinds of event counted when SEARCH_STATS is TRUE; the bounds in pruneOnPermsN() record which of them gave the
+//	value returned, so that the caller can count a cut-off against it
+
+#define STAT_NODES 0
+#define STAT_CUT_MPERM 1
+#define STAT_CUT_OCP 2
+#define STAT_CUT_PARITY 3
+#define STAT_CUT_FALLBACK 4
+#define STAT_TEMPLATE 5
+#define STAT_CUT_MIRROR 6
+#define STAT_CUT_TT 7
+#define N_STATS 8
+
+#define STATS_CSV_HEADER "w,depth,nodes,cutMaxPerm,cutOCP,cutParity,cutFallBack,template,cutMirror,cutTransposition\n"
+
+#if SEARCH_STATS
+
+	#define COUNT_STAT(ss,kind,pos) ((ss)->stats[pos][kind]++);
+	#define SET_CUT_SOURCE(ss,kind) ((ss)->cutSource = (kind));
+
+#else
+
+	#define COUNT_STAT(ss,kind,pos)
+	#define SET_CUT_SOURCE(ss,kind)
 	
 #endif
 
@@ -102,13 +308,156 @@ and restart computations for the w value of the last such file that it finds.
 //	Structure definitions
 //	---------------------
 
+//	Packed into 8 bytes, so that the n-1 choices that follow a given partNum sit in a single 64-byte cache line;
+//	the ranks are at most fn = n! <= 40320, so they fit in 16 bits.
+
 struct digitScore
 {
-int digit;
-int score;
-int fullNum;
-int nextPart;
-int nextPerm;
+uint32_t nextPart:24;
+uint32_t digit:4;
+uint32_t score:4;
+uint16_t fullRank;		//	Rank of the permutation we get by appending the digit, or fn if there is none
+uint16_t nextRank;		//	Rank of the unique permutation we can reach after 0 or 1 wasted characters, or fn if there is none
+};
+
+//	Stride, in entries, between the rows of nextDigits for successive partNum values, and in digitSlot
+
+#define DS_ROW 8
+#define DS_ALIGN (DS_ROW*sizeof(struct digitScore))
+
+//	An entry in the transposition table, recording that from the state with a given hash key (the set of permutations
+//	visited, the last n-1 digits, and whether the last digit completed a permutation), no string wasting at most spareW
+//	more characters can visit a total of need permutations.
+//
+//	The data is packed as need + (spareW << 32), and stored alongside check = key ^ data.  The table is shared by all
+//	threads without any locking, so an entry can be half-written by one thread while another reads it, but then the check
+//	will fail to match the key and we just treat it as absent.
+
+struct ttEntry
+{
+uint64_t check;
+uint64_t data;
+};
+
+//	Frame for one level of the explicit stack used by fillStr()
+
+struct frame
+{
+int pfound;				//	Number of distinct permutations visited
+int partNum;			//	Index of the last n-1 digits
+int leftPerm;			//	Flag saying whether the last digit completed a new permutation
+int mirrorDecided;		//	Flag saying the string is already known to be in canonical orientation
+int spareW;				//	Maximum number of further characters we can waste while not exceeding tot_bl
+int y;					//	Index into the loop over choices for the next digit
+int rank;				//	Rank of the permutation visited by the current choice, or -1 if it visited none
+int deltaMaxPerm;		//	Amount max_perm was increased by a string found at this level
+char swap01, swap12;	//	Flags for reordering the first few choices
+char deferredRepeat;	//	Flag saying we have a choice that repeats a permutation to follow last
+char phase;				//	PHASE_CHOICES while working through the loop, PHASE_DEFERRED while following the repeat
+char order[MAX_N];		//	With the "history" option, the order in which to try the choices, or order[0] = -1 for the usual order
+};
+
+#define PHASE_CHOICES 0
+#define PHASE_DEFERRED 1
+
+//	Frame for one level of the stack used by fillStrTrieN()
+
+struct trieFrame
+{
+int node;		//	Index in the trie of the next child to try
+int end;		//	Index just past the last child
+int pos;		//	Position in the string of the digit the children supply
+int pfound;		//	Number of distinct permutations visited
+int partNum;	//	Index of the last n-1 digits
+int mark;		//	Length of the visit log before we follow the current child
+};
+
+//	A subtree of the search, queued to be explored by a worker thread.
+//
+//	A task restored from a checkpoint might already have been partly explored, in which case it carries the frames for all
+//	the levels from its root down to the node where the search was paused.
+
+struct task
+{
+int pos;				//	Level of the root of the subtree
+int depth;				//	Level of the node where the search of the subtree starts; equal to pos for a fresh task
+int fallBackTo;			//	Level we fall back to when we are deeper in the tree than we need to be
+char *prefix;			//	The first depth digits of the string
+int *dvals;				//	Values of the discriminant at levels 0 ... depth
+struct frame *frames;	//	Frames for levels pos ... depth
+};
+
+//	A search for one candidate value of max_perm, run in a child process when we are speculating
+
+struct lane
+{
+int target;		//	The value of max_perm the search starts with
+pid_t pid;		//	The child process running the search
+int fd;			//	The read end of the pipe the child reports its results through
+int done;		//	Flag saying we have the results, or have cancelled the search
+};
+
+//	What a lane reports when its search is complete; this is followed by nKLB records of known-lower-bound strings,
+//	each consisting of w, mperm_res[w] and klbLen[w] as ints, and the packed string
+
+struct laneResult
+{
+int maxPerm;
+int nBest;
+int bestLen;
+int nKLB;
+unsigned long int nodes;
+long int pruned;
+long int prunedParity;
+long int ttCuts;
+};
+
+//	Double-ended queue of tasks; the owning thread takes tasks from the head, other threads steal them from the tail
+
+struct taskDeque
+{
+struct task **tasks;
+int head, tail;
+pthread_mutex_t lock;
+};
+
+//	Everything that changes as a single thread moves through the search tree
+
+struct searchState
+{
+int id;						//	Index of the thread that owns this state
+char *curstr;				//	Current string
+int *dvals;					//	Value of discriminant at each level
+struct frame *frames;		//	Stack of frames for each level of the search
+struct trieFrame *trieFrames;	//	Stack of frames for following a trie of best strings
+uint64_t *visited;			//	Bits set when we visit a permutation, indexed by rank of permutation
+int *oneCycleCounts;		//	Number of unvisited permutations in each 1-cycle
+int oneCycleCum[MAX_N+2];	//	The numbers of 1-cycles that have at least 0 ... n+1 unvisited permutations
+int oneCycleSum[MAX_N+2];	//	The total unvisited permutations in the 1-cycles that have at least 0 ... n+1 unvisited
+int *oneCycleSorted;		//	The numbers of unvisited permutations in all the 1-cycles, in decreasing order
+int parityCum[2][MAX_N+2];	//	The same information for the 1-cycles of each parity, when we are using the parity bound
+int paritySum[2][MAX_N+2];
+int *paritySorted[2];
+int *visitLog;				//	Ranks of the permutations visited, in the order we visited them, starting with 123...n
+int nVisitLog;				//	Number of entries in visitLog[]
+int fallBackTo;				//	Level we fall back to when we are deeper in the tree than we need to be
+int splitPos;				//	Level at which nodes are queued as new tasks rather than being searched
+struct task **split;		//	Tasks created by splitting
+int nSplit, maxSplit;
+struct taskDeque deque;		//	Tasks waiting to be explored by this thread
+struct task *task;			//	Task currently being explored
+int parkedPos;				//	Level at which the thread is paused for a checkpoint, or -1 if it is paused between tasks
+uint64_t *zHash;			//	Zobrist hash of the set of permutations visited, at each level
+unsigned long int *ttMark;	//	Value of ttEvents when we entered the node at each level
+unsigned long int ttEvents;	//	Count of events that mean a subtree was not proven hopeless: finding a string, falling back, or splitting
+unsigned long int nodeCount;
+long int prunedOCP;
+long int prunedParity;
+long int ttCuts;
+#if SEARCH_STATS
+long int (*stats)[N_STATS];	//	Counts of events at each depth, if SEARCH_STATS is TRUE
+int cutSource;				//	The kind of cut-off due to the last value returned by pruneOnPermsN()
+#endif
 };
 
 //	Global variables
@@ -117,69 +466,165 @@ int nextPerm;
 int n;				//	The number of symbols in the permutations we are considering
 int fn;				//	n!
 int nm;				//	n-1
-int nmbits;			//	(n-1)*DBITS
-int maxInt;			//	Highest integer representation of an n-digit sequence we can encounter, plus 1
-int maxIntM;		//	Highest integer representation of an (n-1)-digit sequence we can encounter, plus 1
+int nParts;			//	Number of (n-1)-digit sequences we can encounter, with no digit straight after itself
 int maxW;			//	Largest number of wasted characters we allow for
-char *curstr;		//	Current string
-int *dvals;			//	Value of discriminant at each level
-int max_perm;		//	Maximum number of permutations visited by any string seen so far
+volatile int max_perm;	//	Maximum number of permutations visited by any string seen so far
 int *mperm_res;		//	For each number of wasted characters, the maximum number of permutations that can be visited
 int *mperm_ruledOut;		//	For each number of wasted characters, the smallest number of permutations currently ruled out
-int *successor1;	//	For each permutation, its weight-1 successor
-int *successor2;	//	For each permutation, its weight-2 successor
+int *successor1;	//	For each permutation rank, the rank of its weight-1 successor
+int *successor2;	//	For each permutation rank, the rank of its weight-2 successor
 int *nBest;			//	For each number of wasted characters, the number of strings that achieve mperm_res permutations
 int *bestLen;		//	For each number of wasted characters, the lengths of the strings that visit final mperm_res permutations
-char **bestStrings;	//	For each number of wasted characters, a list of all strings that visit final mperm_res permutations
+uint8_t **bestStrings;	//	For each number of wasted characters, a packed list of all strings that visit final mperm_res permutations
+long int *bestMapped;	//	For each number of wasted characters, the size of the file mapped into memory for bestStrings[], or 0
+uint32_t **bestTrie;	//	For each number of wasted characters, the best strings compiled into a trie, or NULL
+int *nTrie;				//	For each number of wasted characters, the number of nodes in the trie
 int *klbLen;		//	For each number of wasted characters, the lengths of the strings that visit known-lower-bound permutations
-char **klbStrings;	//	For each number of wasted characters, a list of all strings that visit known-lower-bound permutations
+uint8_t **klbStrings;	//	For each number of wasted characters, a packed string that visits known-lower-bound permutations
 int tot_bl;			//	The total number of wasted characters we are allowing in strings, in current search
-char *unvisited;	//	Flags set FALSE when we visit a permutation, indexed by integer rep of permutation
-char *valid;		//	Flags saying whether integer rep of digit sequence corresponds to a valid permutation
-int *ldd;			//	For each digit sequence, n - (the longest run of distinct digits, starting from the last)
+int *lexRank;		//	For each permutation, in lexicographic order, its rank 0 ... n!-1
+int nWords;			//	Number of 64-bit words in a bitset of visited permutations
+uint8_t *digitSlot;	//	For each (n-1)-digit sequence and each digit 1 ... n, where it appears in that sequence's row of nextDigits
 struct digitScore *nextDigits;	//	For each (n-1)-length digit sequence, possible next digits in preferred order
 
 int noc;				//	Number of 1-cycles
 int nocThresh;			//	Threshold for unvisited 1-cycles before we try new bounds		
-int *oneCycleCounts;	//	Number of unvisited permutations in each 1-cycle
-int *oneCycleIndices;	//	The 1-cycle to which each permutation belongs
-int oneCycleBins[MAX_N+1];	//	The numbers of 1-cycles that have 0 ... n unvisited permutations
+int *oneCycleIndices;	//	The 1-cycle to which each permutation belongs, indexed by rank
+int cycleDelta[MAX_N+1][MAX_N+1];	//	Change in oneCycleSum[b] when a 1-cycle's count of unvisited permutations changes from c to c-1
+int parityTier;			//	TRUE if we back up the 1-cycle bound with the bound from the parities of the 1-cycles
+int *cycleParity;		//	The parity of each 1-cycle, for odd n
+int nParity[2];			//	The number of 1-cycles of each parity
+
+int ttMegabytes=DEFAULT_TT_MEGABYTES;	//	Size of the transposition table, or 0 for none
+struct ttEntry *ttTable=NULL;	//	Transposition table, shared by all threads
+uint64_t ttMask;				//	Number of buckets in the table, minus 1
+int ttActive;					//	TRUE if we are using the table in the current search
+uint64_t *zobrist;				//	Random key for each permutation, indexed by rank
 
 int oneExample=FALSE;	//	Option that when TRUE limits search to a single example
 int allExamples=TRUE;
 int noRepeats=FALSE;
 int allowRepeats=TRUE;
-int fallBackTo;			//	Level we fall back to when we are deeper in the tree than we need to be
-unsigned long int nodeCount=0;
+int noMirrors=FALSE;	//	Option that when TRUE limits the search for all examples to strings in canonical orientation
+int mirrorLen;			//	Length of the strings, if the current search is ruling out strings by orientation, or 0
+int lastW=0;			//	Option to stop after the search for this number of wasted characters, or 0 to run to the end
+int startW=0;			//	Option to start the search at this number of wasted characters, taking the results for lower w from knownMax
+const char *knownFileName=NULL;	//	Option naming a file of known maximum permutation counts, in the form of ChaffinMethodMaxPerms_<n>.txt
+int *knownMax;			//	The maximum permutation count for each w from that file, or 0 if it has none
+unsigned long int nodeCount=0;	//	Total nodes searched by all threads, in searches that have completed
 char outputFileName[256], summaryFileName[256];
+FILE *outputFile=NULL;		//	Output file for the current w, which stays open until the search for that w is finished
+char *outputLine;			//	Buffer for a line of the output file
+uint8_t *foundStrings=NULL;	//	All the strings written to the output file for the current w, packed, if KEEP_STRINGS is TRUE
+long int nFoundBytes=0;		//	Number of bytes used in foundStrings[]
+long int maxFoundBytes=0;	//	Number of bytes allocated for foundStrings[]
+
+//	Threads
+
+int nThreads=1;					//	Number of worker threads
+struct searchState *states;		//	Search state for each thread; states[0] is also used by the main thread
+volatile int searchDone;		//	Set TRUE to tell all threads that the current search is complete
+pthread_mutex_t resultLock = PTHREAD_MUTEX_INITIALIZER;	//	Lock on max_perm, nBest[], bestLen[], lower bounds and the output file
+
+//	Checkpoints
+
+int checkpointMinutes=DEFAULT_CHECKPOINT_MINUTES;	//	Minutes between checkpoints, or 0 for none
+char checkpointFileName[256];
+time_t nextCheckpoint;				//	Time after which we take the next checkpoint
+volatile int checkpointRequested;	//	Set TRUE to tell all threads to pause at the next node they reach
+int nRunning;						//	Number of threads still working through tasks in the current search
+int nParked;						//	Number of threads paused for the checkpoint
+int checkpointGen=0;				//	Incremented after each checkpoint, to release paused threads
+pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t checkpointCond = PTHREAD_COND_INITIALIZER;
+int resumeW=0;						//	The w value of a search to be resumed from a checkpoint, or 0
+struct task **resumeTasks;			//	Tasks from the checkpoint, in the order they should be explored
+int nResumeTasks;
+int speculate=1;					//	Number of candidate values of max_perm to search for at once, in separate processes
+int historyOn=FALSE;				//	Option to try first, among choices that waste equally, the digit that last led to a better string
+uint8_t *historyDigit;				//	For each hashed depth and (n-1)-digit sequence, that digit, or 0 for none
+int old_max;						//	The value of mperm_res[] for one less wasted character than the current search
+int expectedInc;					//	We guess that max_perm will increase by at least this much at each step
 
 //	Monitoring 1-cycle tracking
 
 int ocpTrackingOn, ocpTrackingOff;
-long int prunedOCP=0;
+long int prunedOCP=0;			//	Total for all threads, in searches that have completed
+long int prunedParity=0;
+long int ttCuts=0;
+#if SEARCH_STATS
+long int (*statsTotal)[N_STATS];	//	Counts of events at each depth, for all threads, in searches for the current w that have completed
+char statsFileName[256], statsCPFileName[256];
+#endif
 
 #if GET_OCP_DATA
 int lowestW;
 #else
 //	For n=0,1,2,3,4,5,6,7
-int ocpThreshold[]={1000,1000,1000,1000, 6, 24, 120, 720};
+int ocpThreshold[]={1000,1000,1000,1000, 6, 24, 120, 720, 5040};
 #endif
 
 //	Function definitions
 //	--------------------
 
-void fillStr(int pos, int pfound, int partNum, int leftPerm);
-void fillStr2(int pos, int pfound, int partNum, char *remapDigits, char *bestStr, int len);
+void fillStr(struct searchState *ss, int pos0, int pos);
+KERNEL void fillStrN(struct searchState *ss, int pos0, int pos, const int n, const int nm);
+KERNEL void fillStr2N(struct searchState *ss, int pos, int pfound, int partNum, char *remapDigits, uint8_t *bestStr, int len,
+	const int n);
+KERNEL void fillStrTrieN(struct searchState *ss, int pos, int pfound, int partNum, char *remapDigits, uint32_t *trie, int nNodes,
+	const int n);
+void buildTrie(int w);
 int fac(int k);
 void makePerms(int n, int **permTab);
-void writeCurrentString(int newFile, int size);
-void maybeUpdateLowerBound(int tperm, int size, int w, int p);
-void clearFlags(int tperm0);
+int lexIndex(const char *digits);
+int partIndex(const char *digits);
+int windowRank(const char *str, int e);
+int writeCurrentString(struct searchState *ss, int newFile, int size);
+int mirrorCompare(const char *str, int len);
+void mirrorImage(char *mirror, const char *str, int len);
+void addMirrorImages(int w);
+void closeOutputFile(void);
+void maybeUpdateLowerBound(struct searchState *ss, int rank, int size, int w, int p);
+void initState(struct searchState *ss, int id, int rank0);
+void clearFlags(struct searchState *ss, int rank0);
+void unvisitTo(struct searchState *ss, int mark);
 void readBackFile(FILE *fp, int w);
+void readKnownTable(const char *fileName);
+int mapBestStrings(const char *fileName, int w);
+int mapTables(const char *fileName);
+void writeTables(const char *fileName);
+void writeBestStrings(const char *fileName, int w);
+void writeTextStrings(const char *fileName, int w);
+void freeBestStrings(int w);
+void packDigits(uint8_t *p, const char *digits, int len);
+void unpackDigits(char *digits, const uint8_t *p, int len);
 int compareDS(const void *ii0, const void *jj0);
-void rClassMin(int *p, int n);
-int pruneOnPerms(int w, int d0);
-void printDigits(int t);
+KERNEL int pruneOnPermsN(struct searchState *ss, int w, int d0, const int n);
+KERNEL int permWindowN(const char *str, int e, const int n);
+int parityBound(struct searchState *ss, int w);
+int sumTopCycles(int *cum, int *sum, int *sorted, int size, int k);
+uint64_t splitMix64(uint64_t *x);
+KERNEL uint64_t ttKey(struct searchState *ss, int pos, struct frame *f);
+KERNEL uint32_t historyIndex(int pos, int partNum);
+void recordHistory(const char *str, int pos);
+void searchAll(int partNum0);
+void splitTask(struct searchState *ss, int pos);
+struct task *makeTask(struct searchState *ss, int pos0, int pos);
+void runTask(struct searchState *ss, struct task *tsk);
+struct task *nextTask(struct searchState *ss);
+void *workerThread(void *arg);
+void checkClock(void);
+void parkForCheckpoint(struct searchState *ss, int pos);
+void releaseCheckpoint(void);
+void writeCheckpoint(void);
+int readCheckpoint(void);
+#if SEARCH_STATS
+void writeStats(const char *fileName, const char *mode, int w, int partial);
+void readStats(const char *fileName, int w);
+#endif
+int speculativeSearch(int partNum0);
+void runLane(int partNum0, struct lane *ln, const char *laneFileName);
+void endLane(struct lane *ln, const char *laneFileName);
 
 //	Main program
 //	------------
@@ -195,6 +640,60 @@ if (argc>=2 && argv[1][0]>='0'+MIN_N && argv[1][0]<='0'+MAX_N)
 		{
 	 	if (strcmp(argv[i],"oneExample")==0) oneExample=TRUE;
 	 	else if (strcmp(argv[i],"noRepeats")==0) noRepeats=TRUE;
+	 	else if (strcmp(argv[i],"noMirrors")==0) noMirrors=TRUE;
+	 	else if (strcmp(argv[i],"history")==0) historyOn=TRUE;
+	 	else if (strcmp(argv[i],"threads")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&nThreads)!=1 || nThreads<1 || nThreads>MAX_THREADS)
+	 			{
+	 			printf("The number of threads must be from 1 to %d\n",MAX_THREADS);
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
+	 	else if (strcmp(argv[i],"speculate")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&speculate)!=1 || speculate<1 || speculate>MAX_LANES)
+	 			{
+	 			printf("The number of values of max_perm to search for at once must be from 1 to %d\n",MAX_LANES);
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
+	 	else if (strcmp(argv[i],"transpositions")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&ttMegabytes)!=1 || ttMegabytes<0 || ttMegabytes>MAX_TT_MEGABYTES)
+	 			{
+	 			printf("The size of the transposition table must be from 0 to %d megabytes\n",MAX_TT_MEGABYTES);
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
+	 	else if (strcmp(argv[i],"lastW")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&lastW)!=1 || lastW<1)
+	 			{
+	 			printf("The last number of wasted characters to search for must be 1 or more\n");
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
+	 	else if (strcmp(argv[i],"startW")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&startW)!=1 || startW<1)
+	 			{
+	 			printf("The number of wasted characters to start from must be 1 or more\n");
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
+	 	else if (strcmp(argv[i],"knownTable")==0 && i+1<argc)
+	 		{
+	 		knownFileName = argv[++i];
+	 		}
+	 	else if (strcmp(argv[i],"checkpoint")==0 && i+1<argc)
+	 		{
+	 		if (sscanf(argv[++i],"%d",&checkpointMinutes)!=1 || checkpointMinutes<0)
+	 			{
+	 			printf("The number of minutes between checkpoints must be 0 or more\n");
+	 			exit(EXIT_FAILURE);
+	 			};
+	 		}
 	 	else
 	 		{
 	 		printf("Unknown option %s\n",argv[i]);
@@ -208,21 +707,45 @@ else
 	exit(EXIT_FAILURE);
 	};
 	
+if (historyOn && !oneExample)
+	{
+	printf("The history option only applies when searching for one example\n");
+	exit(EXIT_FAILURE);
+	};
+	
+if (startW && knownFileName==NULL)
+	{
+	printf("The startW option needs a table of the maximum permutation counts for lower w, from the knownTable option\n");
+	exit(EXIT_FAILURE);
+	};
+
+//	Speculative searches that have to share cores are slower than searching one value at a time, because the
+//	searches for lower values of max_perm take much longer than the one that succeeds
+
+if (speculate>1)
+	{
+	long int nCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+	int maxLanes = nCPUs>0 ? nCPUs/nThreads : speculate;
+	if (maxLanes<1) maxLanes = 1;
+	if (speculate>maxLanes)
+		{
+		printf("[Only %ld cores are online, so reducing speculate from %d to %d]\n",nCPUs,speculate,maxLanes);
+		speculate = maxLanes;
+		};
+	};
+
 allExamples = !oneExample;
 allowRepeats = !noRepeats;
 
 sprintf(summaryFileName,"ChaffinMethodMaxPerms_%d.txt",n);
+sprintf(checkpointFileName,"Chaffin_%d_CP%s.bin",n,oneExample?"_OE":"");
+#if SEARCH_STATS
+	sprintf(statsFileName,"Chaffin_%d_Stats%s.csv",n,oneExample?"_OE":"");
+	sprintf(statsCPFileName,"Chaffin_%d_Stats_CP%s.csv",n,oneExample?"_OE":"");
+#endif
 	
 fn=fac(n);
 
-//	Storage for current string
-
-CHECK_MEM( curstr = (char *)malloc(2*fn*sizeof(char)) )
-
-//	Values of discriminant (sign says whether to go deeper)
-
-CHECK_MEM( dvals = (int *)malloc(2*fn*sizeof(int)) )
-
 //	Storage for things associated with different numbers of wasted characters
 
 maxW = fn;
@@ -231,9 +754,13 @@ CHECK_MEM( nBest = (int *)malloc(maxW*sizeof(int)) )
 CHECK_MEM( mperm_res = (int *)malloc(maxW*sizeof(int)) )
 CHECK_MEM( mperm_ruledOut = (int *)malloc(maxW*sizeof(int)) )
 CHECK_MEM( bestLen = (int *)malloc(maxW*sizeof(int)) )
-CHECK_MEM( bestStrings = (char **)malloc(maxW*sizeof(char *)) )
+CHECK_MEM( bestStrings = (uint8_t **)calloc(maxW, sizeof(uint8_t *)) )
+CHECK_MEM( bestMapped = (long int *)calloc(maxW, sizeof(long int)) )
+CHECK_MEM( bestTrie = (uint32_t **)calloc(maxW, sizeof(uint32_t *)) )
+CHECK_MEM( nTrie = (int *)calloc(maxW, sizeof(int)) )
 CHECK_MEM( klbLen = (int *)malloc(maxW*sizeof(int)) )
-CHECK_MEM( klbStrings = (char **)malloc(maxW*sizeof(char *)) )
+CHECK_MEM( klbStrings = (uint8_t **)calloc(maxW, sizeof(uint8_t *)) )
+CHECK_MEM( outputLine = (char *)malloc((2*fn+1)*sizeof(char)) )
 
 //	The value of mperm_res[w] is the highest permutation count that we are current certain can be achieved
 //	with w wasted characters.
@@ -245,28 +772,38 @@ for (int i=0;i<maxW;i++) mperm_res[i]=n;
 
 for (int i=0;i<maxW;i++) mperm_ruledOut[i]=fn+1;
 
-//	Storage for known-lower-bound strings
+//	Storage for known-lower-bound strings is only allocated when we find one
+
+for (int i=0;i<maxW;i++) klbLen[i] = 0;
+
+//	Read any table of known maximum permutation counts; with startW, we need one for every lower w
 
-for (int i=0;i<maxW;i++)
+CHECK_MEM( knownMax = (int *)calloc(maxW, sizeof(int)) )
+if (knownFileName!=NULL) readKnownTable(knownFileName);
+
+if (startW)
 	{
-	CHECK_MEM( klbStrings[i] = (char *)malloc(2*fn*sizeof(char)))
-	klbLen[i] = 0;
+	if (startW>=maxW)
+		{
+		printf("The number of wasted characters to start from must be less than %d\n",maxW);
+		exit(EXIT_FAILURE);
+		};
+	for (int w=1;w<startW;w++)
+	if (knownMax[w]==0 || knownMax[w]>=fn)
+		{
+		printf("The file %s %s for w=%d, so we can't start from w=%d\n",knownFileName,
+			knownMax[w]==0 ? "has no maximum permutation count" : "already gives a superpermutation",w,startW);
+		exit(EXIT_FAILURE);
+		};
 	};
 
-//	Compute number of bits we will shift final digit
-
 nm = n-1;
-nmbits = DBITS*nm;
 
-//	We represent permutations as p_1 + b*p_2 + b^2*p_3 + .... b^(n-1)*p_n, where b=2^(DBITS)
-//	maxInt is the highest value this can take (allowing for non-permutations as well), plus 1
-//	maxIntM is the equivalent for (n-1)-digit sequences
+//	We index the (n-1)-digit sequences by the first digit and the step from each digit to the next (mod n); as no digit ever
+//	follows itself, each step is from 1 to n-1, so there are n*(n-1)^(n-2) sequences
 
-maxIntM = n;
-for (int k=0;k<n-2;k++) maxIntM = (maxIntM<<DBITS)+n;
-maxInt = (maxIntM<<DBITS)+n;
-maxInt++;
-maxIntM++;
+nParts = n;
+for (int k=0;k<n-2;k++) nParts *= nm;
 
 //	Generate a table of all permutations of n symbols
 
@@ -275,27 +812,45 @@ CHECK_MEM( permTab = (int **)malloc(n*sizeof(int *)) )
 makePerms(n,permTab+n-1);
 int *p0 = permTab[n-1];
 
-//	Set up flags that say whether each number is a valid permutation or not,
-//	and whether we have visited a given permutation.
+//	Rank the permutations, so that the n permutations in each 1-cycle have consecutive ranks, in the order
+//	we visit them by following weight-1 edges.  Each 1-cycle is identified by the member that starts with 1.
 //
 //	Also, find the weight-1 and weight-2 successors of each permutation
 
-CHECK_MEM( valid = (char *)malloc(maxInt*sizeof(char)) )
-CHECK_MEM( unvisited = (char *)malloc(maxInt*sizeof(char)) )
-CHECK_MEM( successor1 = (int *)malloc(maxInt*sizeof(int)) )
-CHECK_MEM( successor2 = (int *)malloc(maxInt*sizeof(int)) )
+noc = fac(n-1);
+for (int c=0;c<=MAX_N;c++)
+for (int b=0;b<=MAX_N;b++) cycleDelta[c][b] = b<c ? 1 : b==c ? c : 0;
+nocThresh = noc/2;
+nWords = fn/64+1;
+
+CHECK_MEM( lexRank = (int *)malloc(fn*sizeof(int)) )
+CHECK_MEM( oneCycleIndices = (int *)malloc(fn*sizeof(int)) )
+CHECK_MEM( successor1 = (int *)malloc(fn*sizeof(int)) )
+CHECK_MEM( successor2 = (int *)malloc(fn*sizeof(int)) )
+
+char dseq[MAX_N+1], dseq1[MAX_N], dseq2[MAX_N];
+int oc=0;
+for (int i=0;i<fn;i++)
+if (p0[n*i]==1)
+	{
+	for (int k=0;k<n;k++)
+		{
+		for (int j0=0;j0<n;j0++) dseq[j0] = p0[n*i+(j0+k)%n];
+		lexRank[lexIndex(dseq)]=oc*n+k;
+		oneCycleIndices[oc*n+k]=oc;
+		};
+	oc++;
+	};
 
-for (int i=0;i<maxInt;i++) valid[i]=FALSE;
 for (int i=0;i<fn;i++)
 	{
-	int tperm=0, tperm1=0, tperm2=0;
 	for (int j0=0;j0<n;j0++)
 		{
-		tperm+=(p0[n*i+j0]<<(j0*DBITS));
+		dseq[j0] = p0[n*i+j0];
 		
 		//	Left shift digits by one to get weight-1 successor
 		
-		tperm1+=(p0[n*i+(j0+1)%n]<<(j0*DBITS));
+		dseq1[j0] = p0[n*i+(j0+1)%n];
 		
 		//	Left shift digits by 2 and swap last pair
 		
@@ -304,158 +859,109 @@ for (int i=0;i<fn;i++)
 		else if (j0==n-2) k0=1;
 		else k0=(j0+2)%n;
 		
-		tperm2+=(p0[n*i+k0]<<(j0*DBITS));
+		dseq2[j0] = p0[n*i+k0];
 		};
-	valid[tperm]=TRUE;
-	successor1[tperm]=tperm1;
-	successor2[tperm]=tperm2;
-/*
-		printDigits(tperm);
-		printDigits(tperm1);
-		printDigits(tperm2);
-		printf("----\n");
-*/
+	int r = lexRank[lexIndex(dseq)];
+	successor1[r]=lexRank[lexIndex(dseq1)];
+	successor2[r]=lexRank[lexIndex(dseq2)];
 	};
 	
-//	For each number d_1 d_2 d_3 ... d_n as a digit sequence, what is
-//	the length of the longest run d_j ... d_n in which all the digits are distinct.
-
-//	Also, record which 1-cycle each permutation belongs to
-
-CHECK_MEM( ldd = (int *)malloc(maxInt*sizeof(int)) )
-
-noc = fac(n-1);
-nocThresh = noc/2;
-CHECK_MEM( oneCycleCounts = (int *)malloc(maxInt*sizeof(int)) )
-CHECK_MEM( oneCycleIndices = (int *)malloc(maxInt*sizeof(int)) )
+//	For odd n, rotating a permutation doesn't change its parity, so every member of a 1-cycle has the same parity.
+//	A weight-2 edge that leaves a 1-cycle swaps two symbols that are adjacent in the cyclic order, so it always leads
+//	to a 1-cycle of the opposite parity.
 
-//	Loop through all n-digit sequences
-
-static int dseq[MAX_N], dseq2[MAX_N];
-for (int i=0;i<n;i++) dseq[i]=1;
-int more=TRUE;
-while (more)
+parityTier = n%2==1;
+if (parityTier)
 	{
-	int tperm=0;
-	for (int j0=0;j0<n;j0++)
-		{
-		tperm+=(dseq[j0]<<(j0*DBITS));
-		};
-		
-	if (valid[tperm])
-		{
-		ldd[tperm]=0;
-		for (int i=0;i<n;i++) dseq2[i]=dseq[i];
-		rClassMin(dseq2,n);
-		int r=0;
-		for (int j0=0;j0<n; j0++)
-			{
-			r+=(dseq2[j0]<<(j0*DBITS));
-			};
-		oneCycleIndices[tperm]=r;
-		}
-	else
+	CHECK_MEM( cycleParity = (int *)malloc(noc*sizeof(int)) )
+	nParity[0] = nParity[1] = 0;
+	oc=0;
+	for (int i=0;i<fn;i++)
+	if (p0[n*i]==1)
 		{
-		int ok=TRUE;
-		for (int l=2;l<=n;l++)
-			{
-			for (int i=0;i<l && ok;i++)
-			for (int j=i+1;j<l;j++)
-				{
-				if (dseq[n-1-i]==dseq[n-1-j])
-					{
-					ok=FALSE;
-					break;
-					};
-				};
-
-			if (!ok)
-				{
-				ldd[tperm] = n-(l-1);
-				break;
-				};
-			};
+		int inv=0;
+		for (int j=0;j<n;j++)
+		for (int k=j+1;k<n;k++) if (p0[n*i+j]>p0[n*i+k]) inv++;
+		cycleParity[oc] = inv%2;
+		nParity[inv%2]++;
+		oc++;
 		};
-		
-	for (int h=n-1;h>=0;h--)
-		{
-		if (++dseq[h]>n)
-			{
-			if (h==0)
-				{
-				more=FALSE;
-				break;
-				};
-			dseq[h]=1;
-			}
-		else break;
-		};	
 	};
 	
 //	Set up a table of the next digits to follow from a given (n-1)-digit sequence
+//
+//	For the larger values of n, we map these tables from a file written by an earlier run, if there is one; otherwise we
+//	build them, and write the file for next time.
 
-CHECK_MEM( nextDigits = (struct digitScore *)malloc(maxIntM*(n-1)*sizeof(struct digitScore)) )
-int dsum = n*(n+1)/2;
+char tablesFileName[256];
+sprintf(tablesFileName,"Chaffin_%d_Tables.bin",n);
+if (n<TABLES_MIN_N || !mapTables(tablesFileName))
+	{
+	if (posix_memalign((void **)&nextDigits,DS_ALIGN,nParts*DS_ALIGN)!=0) nextDigits=NULL;
+	CHECK_MEM( nextDigits )
+	memset(nextDigits, 0, nParts*DS_ALIGN);
+	CHECK_MEM( digitSlot = (uint8_t *)malloc(nParts*DS_ROW*sizeof(uint8_t)) )
+	int dsum = n*(n+1)/2;
 
-//	Loop through all (n-1)-digit sequences
+	//	Loop through all (n-1)-digit sequences, recovering the digits from the index
 
-for (int i=0;i<n-1;i++) dseq[i]=1;
-more=TRUE;
-while (more)
-	{
-	int part=0;
-	for (int j0=0;j0<n-1;j0++)
+	for (int part=0;part<nParts;part++)
 		{
-		part+=(dseq[j0]<<(j0*DBITS));
-		};
-	struct digitScore *nd = nextDigits+(n-1)*part;
+		int x = part;
+		for (int j0=n-2;j0>=1;j0--)
+			{
+			dseq[j0] = x%nm;
+			x /= nm;
+			};
+		dseq[0] = x+1;
+		for (int j0=1;j0<n-1;j0++) dseq[j0] = (dseq[j0-1]+dseq[j0])%n + 1;
+		struct digitScore *nd = nextDigits+DS_ROW*part;
 		
-	//	Sort potential next digits by the ldd score we get by appending them
+		//	Sort potential next digits by the ldd score we get by appending them: n - (the longest run of distinct digits,
+		//	starting from the last)
 	
-	int q=0;
-	for (int d=1;d<=n;d++)
-	if (d != dseq[n-2])
-		{
-		int t = (d<<nmbits) + part;
-		nd[q].digit = d;
-		int ld = nd[q].score = ldd[t];
+		int q=0;
+		for (int d=1;d<=n;d++)
+		if (d != dseq[n-2])
+			{
+			dseq[n-1] = d;
+			nd[q].digit = d;
 		
-		//	The full number n-digit number we get if we append the chosen digit to the previous n-1
+			int l=1, distinct=TRUE;
+			while (l<n && distinct)
+				{
+				for (int j=n-l;j<n;j++) if (dseq[j]==dseq[n-1-l]) distinct=FALSE;
+				if (distinct) l++;
+				};
+			int ld = nd[q].score = n-l;
 		
-		nd[q].fullNum = t;
+			//	The rank of the permutation we get if we append the chosen digit to the previous n-1, if it is one
 		
-		//	The next (n-1)-digit partial number that follows (dropping oldest of the current n)
+			nd[q].fullRank = ld==0 ? lexRank[lexIndex(dseq)] : fn;
 		
-		int p = nd[q].nextPart = t>>DBITS;
+			//	The next (n-1)-digit sequence that follows (dropping oldest of the current n)
 		
-		//	If there is a unique permutation after 0 or 1 wasted characters, precompute its number
+			nd[q].nextPart = partIndex(dseq+1);
 		
-		if (ld==0) nd[q].nextPerm = t;		//	Adding the current chosen digit gets us there
-		else if (ld==1)						//	After the current chosen digit, a single subsequent choice gives a unique permutation
-			{
-			int d2 = dsum-d;
-			for (int z=1;z<=n-2;z++) d2-=dseq[z];
-			nd[q].nextPerm = (d2<<nmbits) + p;
-			}
-		else nd[q].nextPerm = -1;
-		q++;
-		};
+			//	If there is a unique permutation after 0 or 1 wasted characters, precompute its number
 		
-	qsort(nd,n-1,sizeof(struct digitScore),compareDS);
-	
-	for (int h=n-2;h>=0;h--)
-		{
-		if (++dseq[h]>n)
-			{
-			if (h==0)
+			if (ld==0) nd[q].nextRank = nd[q].fullRank;		//	Adding the current chosen digit gets us there
+			else if (ld==1)						//	After the current chosen digit, a single subsequent choice gives a unique permutation
 				{
-				more=FALSE;
-				break;
-				};
-			dseq[h]=1;
-			}
-		else break;
-		};	
+				int d2 = dsum;
+				for (int z=1;z<=n-1;z++) d2-=dseq[z];
+				dseq[n] = d2;
+				nd[q].nextRank = lexRank[lexIndex(dseq+1)];
+				}
+			else nd[q].nextRank = fn;
+			q++;
+			};
+		
+		qsort(nd,n-1,sizeof(struct digitScore),compareDS);
+		for (int k=0;k<n-1;k++) digitSlot[DS_ROW*part+nd[k].digit-1] = k;
+		};
+	
+	if (n>=TABLES_MIN_N) writeTables(tablesFileName);
 	};
 	
 mperm_res[0] = n;		//	With no wasted characters, we can visit n permutations
@@ -466,83 +972,180 @@ max_perm = n;			//	Any new maximum (for however many wasted characters) must exc
 
 bestLen[0] = 2*n-1;
 nBest[0] = 1;
-CHECK_MEM( bestStrings[0] = (char *)malloc(bestLen[0]*nBest[0]*sizeof(char)) )
-for (int i=0;i<n;i++) bestStrings[0][i]=i+1;
-for (int i=n;i<2*n-1;i++) bestStrings[0][i]=i-n+1;
+char str0[2*MAX_N];
+for (int i=0;i<n;i++) str0[i]=i+1;
+for (int i=n;i<2*n-1;i++) str0[i]=i-n+1;
+CHECK_MEM( bestStrings[0] = (uint8_t *)calloc(PACKED_SIZE(bestLen[0])+PACKED_PADDING, sizeof(uint8_t)) )
+packDigits(bestStrings[0], str0, bestLen[0]);
 						
-//	Fill the first n entries of the string with [1...n], and compute the
-//	associated integer, as well as the partial integer for [2...n]
+//	The string starts with [1...n], so the first permutation has the rank of 123...n, and the first (n-1)-digit sequence
+//	is [2...n]
+
+int partNum0 = partIndex(str0+1);
+int rank0 = windowRank(str0, n-1);
 
-int tperm0=0;
-for (int j0=0;j0<n;j0++)
+//	Random keys for the permutations, for the Zobrist hash of the set we have visited, which is just the XOR of the keys of
+//	all its members; we use a fixed seed, so that the search is the same on every run.
+//
+//	The transposition table has a power of 2 buckets, filling at most ttMegabytes.
+
+CHECK_MEM( zobrist = (uint64_t *)malloc(fn*sizeof(uint64_t)) )
+uint64_t zSeed = 0;
+for (int i=0;i<fn;i++) zobrist[i] = splitMix64(&zSeed);
+
+if (ttMegabytes>0)
 	{
-	curstr[j0] = j0+1;
-	tperm0 += (j0+1)<<(j0*DBITS);
+	uint64_t nBuckets = 1;
+	while (2*nBuckets*TT_BUCKET*sizeof(struct ttEntry) <= ((uint64_t)ttMegabytes<<20)) nBuckets *= 2;
+	if (posix_memalign((void **)&ttTable,TT_BUCKET*sizeof(struct ttEntry),nBuckets*TT_BUCKET*sizeof(struct ttEntry))!=0) ttTable=NULL;
+	CHECK_MEM( ttTable )
+	memset(ttTable, 0, nBuckets*TT_BUCKET*sizeof(struct ttEntry));
+	ttMask = nBuckets-1;
 	};
-int partNum0 = tperm0>>DBITS;
+
+if (historyOn) CHECK_MEM( historyDigit = (uint8_t *)calloc((size_t)1<<HISTORY_BITS, sizeof(uint8_t)) )
+
+//	Set up the search state for each thread
+
+CHECK_MEM( states = (struct searchState *)malloc(nThreads*sizeof(struct searchState)) )
+for (int i=0;i<nThreads;i++) initState(states+i, i, rank0);
+
+#if SEARCH_STATS
+	CHECK_MEM( statsTotal = (long int (*)[N_STATS])calloc(2*fn+2, sizeof(*statsTotal)) )
+#endif
+
+expectedInc = 2*(n-4);
+
+//	Check for a checkpoint of a search that was interrupted part-way through; if there is one, it holds all the
+//	information we need from files for lower w values, except for the strings themselves
+
+resumeW = readCheckpoint();
+#if SEARCH_STATS
+	if (resumeW) readStats(statsCPFileName, resumeW);
+#endif
 
 //	Check for any pre-existing files
 
 int resumeFrom = 1;
 int didResume = FALSE;
 
-for (tot_bl=1; tot_bl<maxW; tot_bl++)
+for (tot_bl=1; tot_bl<maxW && (resumeW==0 || tot_bl<resumeW); tot_bl++)
 	{
+	//	Use the packed file if we have one, otherwise the text file
+	
+	char binFileName[256];
+	sprintf(binFileName,"Chaffin_%d_W_%d%s.bin",n,tot_bl,oneExample?"_OE":"");
 	sprintf(outputFileName,"Chaffin_%d_W_%d%s.txt",n,tot_bl,oneExample?"_OE":"");
-	fp = fopen(outputFileName,"rt");
-	if (fp==NULL)
+	if (!mapBestStrings(binFileName, tot_bl))
 		{
-		sprintf(outputFileName,"Chaffin_%d_W_%d.txt",n,tot_bl);
-		fp = fopen(outputFileName,"rt");
-		if (fp==NULL) break;
+		sprintf(binFileName,"Chaffin_%d_W_%d.bin",n,tot_bl);
+		if (mapBestStrings(binFileName, tot_bl)) sprintf(outputFileName,"Chaffin_%d_W_%d.txt",n,tot_bl);
 		};
-	
-	printf("Reading pre-existing file %s ...\n",outputFileName);
-	bestLen[tot_bl] = 0;
-	nBest[tot_bl] = 0;
-	while (TRUE)
+		
+	//	When we are starting from startW, we take the maximum permutation count for any lower w from the known table unless we
+	//	have a complete list of strings for it, which only a packed file guarantees.  Without the strings, the search for
+	//	higher w can't use them as templates, but it is still exhaustive.
+		
+	if (tot_bl<startW && !bestMapped[tot_bl])
 		{
-		int c = fgetc(fp);
-		if (c==EOF) break;
-		if (c=='\n') nBest[tot_bl]++;
-		if (nBest[tot_bl]==0) bestLen[tot_bl]++;
+		mperm_res[tot_bl] = knownMax[tot_bl];
+		bestLen[tot_bl] = mperm_res[tot_bl] + tot_bl + n-1;
+		nBest[tot_bl] = 0;
+		printf("Taking %d permutations for w=%d from %s\n",mperm_res[tot_bl],tot_bl,knownFileName);
+		resumeFrom = tot_bl+1;
+		didResume = FALSE;
+		continue;
+		};
+		
+	if (bestMapped[tot_bl])
+		{
+		strcpy(outputFileName, binFileName);
+		}
+	else
+		{
+		fp = fopen(outputFileName,"rt");
+		if (fp==NULL)
+			{
+			sprintf(outputFileName,"Chaffin_%d_W_%d.txt",n,tot_bl);
+			fp = fopen(outputFileName,"rt");
+			if (fp==NULL) break;
+			};
+	
+		printf("Reading pre-existing file %s ...\n",outputFileName);
+		bestLen[tot_bl] = 0;
+		nBest[tot_bl] = 0;
+		while (TRUE)
+			{
+			int c = fgetc(fp);
+			if (c==EOF) break;
+			if (c=='\n') nBest[tot_bl]++;
+			if (nBest[tot_bl]==0) bestLen[tot_bl]++;
+			};
+		fclose(fp);
+		fp = fopen(outputFileName,"rt");
+		readBackFile(fp, tot_bl);
+		fclose(fp);
+		
+		//	The file might have been written with the "noMirrors" option, so restore any strings that were left out
+		
+		if (allExamples) addMirrorImages(tot_bl);
 		};
-	fclose(fp);
-	fp = fopen(outputFileName,"rt");
-	readBackFile(fp, tot_bl);
-	fclose(fp);
 	
 	mperm_res[tot_bl] = bestLen[tot_bl] - tot_bl - (n-1);
 	
 	printf("Found %d strings of length %d, implying %d permutations, in file %s\n",nBest[tot_bl],bestLen[tot_bl],mperm_res[tot_bl],outputFileName);
+	if (knownMax[tot_bl] && knownMax[tot_bl]!=mperm_res[tot_bl])
+		printf("Warning: the file %s gives %d permutations for w=%d\n",knownFileName,knownMax[tot_bl],tot_bl);
 	
-	resumeFrom = tot_bl;
-	didResume = TRUE;
+	//	The last list we find is searched for again, in case it is incomplete, unless it is a packed list below startW
+	
+	if (tot_bl<startW)
+		{
+		resumeFrom = tot_bl+1;
+		didResume = FALSE;
+		}
+	else
+		{
+		resumeFrom = tot_bl;
+		didResume = TRUE;
+		};
 	};
+	
+if (resumeW > 0)
+	{
+	if (resumeW != tot_bl)
+		{
+		printf("The checkpoint file %s is for w=%d, but the files for lower w values are incomplete\n",checkpointFileName,resumeW);
+		exit(EXIT_FAILURE);
+		};
+	resumeFrom = resumeW;
+	};
+	
+//	Save packed copies of any lists we read from text files, apart from the one for the w we are about to redo
+
+for (int w=1;w<resumeFrom;w++)
+if (!bestMapped[w] && nBest[w]>0)
+	{
+	sprintf(outputFileName,"Chaffin_%d_W_%d%s.bin",n,w,oneExample?"_OE":"");
+	writeBestStrings(outputFileName, w);
+	};
+	
+for (int w=0;w<resumeFrom;w++) if (nBest[w]>0) buildTrie(w);
+	
+nextCheckpoint = time(NULL) + 60*checkpointMinutes;
 						
 //	tot_bl is the total number of wasted characters we are allowing in strings;
 //	we loop through increasing the value
 
-int expectedInc = 2*(n-4);			//	We guess that max_perm will increase by at least this much at each step
-
 #if GET_OCP_DATA
 lowestW=maxW;
 #endif
 
-//	Set up 1-cycle information
-
-for (int i=0;i<maxInt;i++) oneCycleCounts[i]=n;
-oneCycleCounts[oneCycleIndices[tperm0]]=n-1;
-
-for (int b=0;b<n-1;b++) oneCycleBins[b]=0;
-oneCycleBins[n]=noc-1;
-oneCycleBins[n-1]=1;
-
 for (tot_bl=resumeFrom; tot_bl<maxW; tot_bl++)
 	{
 	//	Rule out increasing by more than n when we add one more wasted character
 	
-	mperm_ruledOut[tot_bl] = mperm_res[tot_bl-1] + n + 1;
+	if (!resumeW) mperm_ruledOut[tot_bl] = mperm_res[tot_bl-1] + n + 1;
 
 	sprintf(outputFileName,"Chaffin_%d_W_%d%s.txt",n,tot_bl,oneExample?"_OE":"");
 	
@@ -554,55 +1157,80 @@ for (tot_bl=resumeFrom; tot_bl<maxW; tot_bl++)
 	#endif
 	ocpTrackingOff = !ocpTrackingOn;
 	
-	//	Gamble on max_perm increasing by at least expectedInc; if it doesn't, we will decrement it and retry
+	//	If we are resuming from a checkpoint, max_perm and everything else we need were restored from it
 	
-	int old_max = mperm_res[tot_bl-1];
-	max_perm = old_max + expectedInc;
+	if (resumeW)
+		{
+		printf("[Resuming search for w=%d from checkpoint, with max_perm of %d, mperm_ruledOut=%d]\n",tot_bl,max_perm,mperm_ruledOut[tot_bl]);
+		}
+	else
+		{
+		//	Gamble on max_perm increasing by at least expectedInc; if it doesn't, we will decrement it and retry
+	
+		old_max = mperm_res[tot_bl-1];
+		max_perm = old_max + expectedInc;
+		
+		//	If we have a known maximum for this w, we start by searching for that instead
+		
+		if (knownMax[tot_bl]) max_perm = allExamples ? knownMax[tot_bl] : knownMax[tot_bl]-1;
+		
+		//	If we are leaving out mirror images, we need to be sure max_perm can't increase, so we start as high as we can
+		
+		if (noMirrors && allExamples) max_perm = mperm_ruledOut[tot_bl]-1;
 	
-	printf("[Starting search for w=%d, with initial max_perm of %d, mperm_ruledOut=%d]\n",tot_bl,max_perm,mperm_ruledOut[tot_bl]);
+		printf("[Starting search for w=%d, with initial max_perm of %d, mperm_ruledOut=%d]\n",tot_bl,max_perm,mperm_ruledOut[tot_bl]);
 	
-	//	Look at lower bound we might have obtained from previous calculation
+		//	Look at lower bound we might have obtained from previous calculation
 	
-	nBest[tot_bl]=0;
-	if (klbLen[tot_bl] > 0 && mperm_res[tot_bl] >= max_perm)
-		{
-		for (int k=0;k<klbLen[tot_bl];k++) curstr[k]=klbStrings[tot_bl][k];
-		writeCurrentString(TRUE,klbLen[tot_bl]);
-		max_perm = mperm_res[tot_bl];
-		nBest[tot_bl]=1;
-		bestLen[tot_bl]=klbLen[tot_bl];
-		printf("[Using max_perm of %d from previous calculations]\n",max_perm);
+		nBest[tot_bl]=0;
+		if (klbLen[tot_bl] > 0 && mperm_res[tot_bl] >= max_perm)
+			{
+			unpackDigits(states[0].curstr, klbStrings[tot_bl], klbLen[tot_bl]);
+			nBest[tot_bl] = writeCurrentString(states,TRUE,klbLen[tot_bl]);
+			max_perm = mperm_res[tot_bl];
+			bestLen[tot_bl]=klbLen[tot_bl];
+			printf("[Using max_perm of %d from previous calculations]\n",max_perm);
+			};
 		};
 		
-	if (oneExample && klbLen[tot_bl]>0 && mperm_res[tot_bl]+1 >= mperm_ruledOut[tot_bl])
+	if (!resumeW && oneExample && klbLen[tot_bl]>0 && mperm_res[tot_bl]+1 >= mperm_ruledOut[tot_bl])
 		{
 		printf("[Extending strings from previous calculations already gave us an answer:]\n");
 		}
 	else
 		{
-		if (allExamples)
+		if (!resumeW)
 			{
-			nBest[tot_bl]=0;
-			if (max_perm > fn) max_perm = fn;
-			}
-		else
-			{
-			if (max_perm >= fn) max_perm = fn-1;
-			};
+			if (allExamples)
+				{
+				nBest[tot_bl]=0;
+				if (max_perm > fn) max_perm = fn;
+				}
+			else
+				{
+				if (max_perm >= fn) max_perm = fn-1;
+				};
 		
-		if (didResume && tot_bl==resumeFrom)
-			{
-			max_perm = mperm_res[resumeFrom];
+			if (didResume && tot_bl==resumeFrom)
+				{
+				max_perm = mperm_res[resumeFrom];
+				};
 			};
 		
-		//	Recursively fill in the string
+		//	Recursively fill in the string (the first search picks up from the checkpoint, if we are resuming).
+		//
+		//	If we are speculating, and don't already have a string for this w, we search for several values of max_perm at once.
 
 		while (max_perm>0)
 			{
-			clearFlags(tperm0);
+			if (speculate>1 && !resumeW && nBest[tot_bl]==0)
+				{
+				if (speculativeSearch(partNum0)) break;
+				continue;
+				};
+				
 			bestLen[tot_bl]=max_perm+tot_bl+n-1;
-			fallBackTo=2*fn;
-			fillStr(n,1,partNum0,TRUE);
+			searchAll(partNum0);
 			if (nBest[tot_bl] > 0) break;
 			
 			//	We searched either for matches to max_perm (allExamples) or strings that did better than max_perm (oneExample), and came up empty
@@ -624,6 +1252,35 @@ for (tot_bl=resumeFrom; tot_bl<maxW; tot_bl++)
 			};
 
 		};
+		
+	closeOutputFile();
+	
+	//	Keep the list of best strings, adding the mirror images of those we wrote if we left them out
+	
+	freeBestStrings(tot_bl);
+	#if KEEP_STRINGS
+		bestStrings[tot_bl] = foundStrings;
+		foundStrings = NULL;
+		nFoundBytes = maxFoundBytes = 0;
+	#else
+		fp = fopen(outputFileName,"rt");
+		if (fp==NULL)
+			{
+			printf("Unable to open file %s to read\n",outputFileName);
+			exit(EXIT_FAILURE);
+			};
+	
+		readBackFile(fp, tot_bl);
+		fclose(fp);
+	#endif
+	
+	if (noMirrors && allExamples)
+		{
+		int nWritten = nBest[tot_bl];
+		addMirrorImages(tot_bl);
+		writeTextStrings(outputFileName, tot_bl);
+		printf("[Found %d strings, and added %d mirror images to %s]\n",nWritten,nBest[tot_bl]-nWritten,outputFileName);
+		};
 	
 	//	Record maximum number of permutations visited with this many wasted characters
 
@@ -639,6 +1296,16 @@ for (tot_bl=resumeFrom; tot_bl<maxW; tot_bl++)
 		fclose(fp);
 		};
 		
+	//	Any checkpoint taken during the search is now out of date
+	
+	remove(checkpointFileName);
+	
+	#if SEARCH_STATS
+		writeStats(statsFileName, "at", tot_bl, FALSE);
+		memset(statsTotal, 0, (2*fn+2)*sizeof(*statsTotal));
+		remove(statsCPFileName);
+	#endif
+		
 	if (max_perm >= fn)
 		{
 		printf("\n-----\nDONE!\n-----\nMinimal superpermutations on %d symbols have %d wasted characters and a length of %d.\n\n",
@@ -646,57 +1313,161 @@ for (tot_bl=resumeFrom; tot_bl<maxW; tot_bl++)
 		break;
 		};
 		
-	//	Read back list of best strings
+	//	Save the list of best strings in packed form too
 	
-	fp = fopen(outputFileName,"rt");
-	if (fp==NULL)
+	sprintf(outputFileName,"Chaffin_%d_W_%d%s.bin",n,tot_bl,oneExample?"_OE":"");
+	writeBestStrings(outputFileName, tot_bl);
+	
+	if (lastW && tot_bl>=lastW)
 		{
-		printf("Unable to open file %s to read\n",outputFileName);
-		exit(EXIT_FAILURE);
+		printf("[Stopping after w=%d, as requested]\n\n",tot_bl);
+		break;
 		};
-	
-	readBackFile(fp, tot_bl);
-	fclose(fp);
+		
+	buildTrie(tot_bl);
 	};
 	
 #if GET_OCP_DATA
 PRINT_OCP_DATA
 #endif
 printf("OCP tracking pruned the search %ld times\n",prunedOCP);
+if (parityTier) printf("The 1-cycle parity bound pruned the search %ld more times\n",prunedParity);
+if (ttTable!=NULL) printf("The transposition table pruned the search %ld more times\n",ttCuts);
 
 return 0;
 }
 
-// this function recursively fills the string
+//	This function fills the string, exploring the whole subtree below the node at level pos0.
+//
+//	Rather than calling itself recursively, it keeps an explicit stack of frames in the thread's search state,
+//	one for each level of the tree, with frames[pos] holding everything needed to resume the loop over the
+//	choices of next digit at that level when we return to it.
+//
+//	The search starts by entering the node at level pos, whose frame must have pfound, partNum and leftPerm set.
+//	Normally pos is equal to pos0, but when resuming from a checkpoint, the frames for levels pos0 ... pos-1 can
+//	already hold the state of a search that was part-way through the subtree.
+//
+//	The arguments n and nm take the place of the global variables of the same names, and are always constants, so that
+//	the compiler can generate a copy of the search for each value of n with the loops and arithmetic that depend on n
+//	simplified; fillStr() just picks the right copy.
+
+#define FILLSTR_FOR_N(N) void fillStr##N(struct searchState *ss, int pos0, int pos) {fillStrN(ss,pos0,pos,N,N-1);}
+
+FILLSTR_FOR_N(3)
+FILLSTR_FOR_N(4)
+FILLSTR_FOR_N(5)
+FILLSTR_FOR_N(6)
+FILLSTR_FOR_N(7)
+FILLSTR_FOR_N(8)
 
-void fillStr(int pos, int pfound, int partNum, int leftPerm)
+void fillStr(struct searchState *ss, int pos0, int pos)
 {
-if (pos > fallBackTo) return; else fallBackTo = 2*fn;
-nodeCount++;
+switch (n)
+	{
+	case 3: fillStr3(ss,pos0,pos); break;
+	case 4: fillStr4(ss,pos0,pos); break;
+	case 5: fillStr5(ss,pos0,pos); break;
+	case 6: fillStr6(ss,pos0,pos); break;
+	case 7: fillStr7(ss,pos0,pos); break;
+	case 8: fillStr8(ss,pos0,pos); break;
+	};
+}
+
+KERNEL void fillStrN(struct searchState *ss, int pos0, int pos, const int n, const int nm)
+{
+char *curstr = ss->curstr;
+uint64_t *visited = ss->visited;
+int *dvals = ss->dvals;
+struct frame *f = ss->frames+pos;
+struct digitScore *nd, *ndz;
+int rank, ld, z, d, spareW0, vperm;
+
+enterNode:
+
+//	We have just arrived at a new node at level pos, with frame f
+
+if (pos > ss->fallBackTo || searchDone)
+	{
+	if (!searchDone) COUNT_STAT(ss,STAT_CUT_FALLBACK,pos)
+	ss->ttEvents++;
+	goto leaveNode;
+	}
+else ss->fallBackTo = 2*fn;
+
+//	If we are splitting the tree, queue this node as a task rather than searching it
+
+if (pos >= ss->splitPos)
+	{
+	splitTask(ss, pos);
+	ss->ttEvents++;
+	goto leaveNode;
+	};
+
+//	Every so often, see if it is time for a checkpoint, and if one has been requested, pause here; the frames for levels
+//	pos0 ... pos are all we need to resume the search from this node.  (Checkpoints are never taken while we are splitting
+//	the tree, which is only done before the other threads start work.)
+
+COUNT_STAT(ss,STAT_NODES,pos)
 
-int tperm, ld;
-int alreadyWasted = pos - pfound - n + 1;	//	Number of character wasted so far
-int spareW = tot_bl - alreadyWasted;		//	Maximum number of further characters we can waste while not exceeding tot_bl
+if ((++ss->nodeCount & (CLOCK_CHECK_NODES-1))==0 && checkpointMinutes>0 && ss->splitPos > 2*fn)
+	{
+	checkClock();
+	if (checkpointRequested) parkForCheckpoint(ss, pos);
+	};
+
+//	Maximum number of further characters we can waste while not exceeding tot_bl, given the number already wasted
+
+f->spareW = tot_bl - (pos - f->pfound - n + 1);
+
+//	If the transposition table tells us we have been in the same state before, with at least as many characters to spare,
+//	and found no string that visits as many permutations as we now need, there is no point searching the subtree again
+
+ss->ttMark[pos] = ss->ttEvents;
+if (ttActive && f->spareW + TT_MAX_WASTED >= tot_bl)
+	{
+	uint64_t key = ttKey(ss,pos,f);
+	struct ttEntry *b = ttTable + TT_BUCKET*(key & ttMask);
+	uint64_t need = allExamples ? max_perm : max_perm+1;
+	for (int i=0;i<TT_BUCKET;i++)
+		{
+		uint64_t data = b[i].data;
+		if ((b[i].check ^ data)==key && data!=0 && (data>>32) >= f->spareW && (data & 0xffffffff) <= need)
+			{
+			ss->ttCuts++;
+			COUNT_STAT(ss,STAT_CUT_TT,pos)
+			goto leaveNode;
+			};
+		};
+	};
 
 //	If we can only match the current max_perm by using an optimal string for our remaining quota of wasted characters,
 //	we try using those strings (remapping digits to make them start from the permutation we just visited).
 
-if	(allExamples && leftPerm && spareW < tot_bl && mperm_res[spareW] + pfound - 1 == max_perm)
+if	(allExamples && f->leftPerm && f->spareW < tot_bl && mperm_res[f->spareW] + f->pfound - 1 == max_perm && nBest[f->spareW]>0)
 	{
-	for (int i=0;i<nBest[spareW];i++)
+	char *remapDigits = curstr + pos - n - 1;
+	COUNT_STAT(ss,STAT_TEMPLATE,pos)
+	if (bestTrie[f->spareW]!=NULL)
 		{
-		int len = bestLen[spareW];
-		char *bestStr = bestStrings[spareW] + i*len;
-		char *remapDigits = curstr + pos - n - 1;
-		fillStr2(pos,pfound,partNum,remapDigits,bestStr+n,len-n);
+		fillStrTrieN(ss,pos,f->pfound,f->partNum,remapDigits,bestTrie[f->spareW],nTrie[f->spareW],n);
+		}
+	else
+		{
+		int len = bestLen[f->spareW];
+		long int size = PACKED_SIZE(len);
+		for (int i=0;i<nBest[f->spareW];i++)
+			{
+			uint8_t *bestStr = bestStrings[f->spareW] + i*size;
+			fillStr2N(ss,pos,f->pfound,f->partNum,remapDigits,bestStr,len-n,n);
+			};
 		};
-	return;
+	goto finishNode;
 	};
 	
 //	Loop to try each possible next digit we could append.
-//	These have been sorted into increasing order of ldd[tperm], the minimum number of further wasted characters needed to get a permutation.
+//	These have been sorted into increasing order of their ldd score, the minimum number of further wasted characters needed to get a permutation.
 	
-struct digitScore *nd = nextDigits + nm*partNum;
+nd = nextDigits + DS_ROW*f->partNum;
 
 //	To be able to fully exploit foreknowledge that we are heading for a visited permutation after 1 wasted character, we need to ensure
 //	that we still traverse the loop in order of increasing waste.
@@ -709,7 +1480,7 @@ struct digitScore *nd = nextDigits + nm*partNum;
 //  The affected choices will always be the first two in the loop, and
 //	we only need to swap them if the first permutation is visited and the second is not.
 
-int swap01 = (nd->score==1 && (!unvisited[nd->nextPerm]) && unvisited[nd[1].nextPerm]);
+f->swap01 = (nd->score==1 && VISITED(visited,nd->nextRank) && !VISITED(visited,nd[1].nextRank));
 
 //	Also, it is not obligatory, but useful, to swap the 2nd and 3rd entries (indices 1 and 2) if we have (n-1) distinct digits in the
 //	current prefix, with the first 3 choices ld=0,1,2, but the 1st and 2nd entries lead to a visited permutation.  This will happen
@@ -719,108 +1490,164 @@ int swap01 = (nd->score==1 && (!unvisited[nd->nextPerm]) && unvisited[nd[1].next
 //		1234 | add 1 -> 12341 ld = 1 (but 23415 has been visited already)
 //		1234 | add 2 -> 12342 ld = 2
 
-int swap12 = FALSE;					//	This is set later if the conditions are met
+f->swap12 = FALSE;				//	This is set later if the conditions are met
+
+//	With the "history" option, if a digit has led to a better string from this depth and (n-1)-digit sequence before, we
+//	sort the choices by the number of characters they waste (counting a visited permutation after 1 wasted character
+//	as an extra one, which the swaps above otherwise take care of), and try that digit first among the choices that
+//	waste the same number.  We record the order in the frame, so that it stays the same if we resume the search at this
+//	node later.
+
+f->order[0] = -1;
+if (historyOn)
+	{
+	int k = historyDigit[historyIndex(pos,f->partNum)];
+	if (k>0 && k!=curstr[pos-1])
+		{
+		int kz = digitSlot[DS_ROW*f->partNum+k-1], key[MAX_N];
+		for (int j=0;j<nm;j++)
+			{
+			key[j] = 2*(nd[j].score + (nd[j].score==1 && VISITED(visited,nd[j].nextRank))) + (j!=kz);
+			int i = j;
+			while (i>0 && key[(int)f->order[i-1]] > key[j])
+				{
+				f->order[i] = f->order[i-1];
+				i--;
+				};
+			f->order[i] = j;
+			};
+		};
+	};
+
+f->deferredRepeat = FALSE;		//	If we find a repeated permutation, we follow that branch last
+f->deltaMaxPerm = 0;			//	Amount max_perm is increased by a new string
+f->phase = PHASE_CHOICES;
+f->y = 0;
 
-int deferredRepeat=FALSE;			//	If we find a repeated permutation, we follow that branch last
-int deltaMaxPerm=0;					//	Amount max_perm is increased by a new string
+nextChoice:
 
-for	(int y=0; y<nm; y++)
+for	(; f->y<nm; f->y++)
 	{
-	int z;
-	if (swap01)
+	if (f->order[0]>=0) z=f->order[f->y];
+	else if (f->swap01)
 		{
-		if (y==0) z=1; else if (y==1) {z=0; swap01=FALSE;} else z=y;
+		if (f->y==0) z=1; else if (f->y==1) {z=0; f->swap01=FALSE;} else z=f->y;
 		}
-	else if (swap12)
+	else if (f->swap12)
 		{
-		if (y==1) z=2; else if (y==2) {z=1; swap12=FALSE;} else z=y; 
+		if (f->y==1) z=2; else if (f->y==2) {z=1; f->swap12=FALSE;} else z=f->y; 
 		}
-	else z=y;
+	else z=f->y;
 	
-	struct digitScore *ndz = nd+z;
+	ndz = nd+z;
 	ld = ndz->score;
 	
 	//	ld tells us the minimum number of further characters we would need to waste
 	//	before visiting another permutation.
 	
-	int spareW0 = spareW - ld;
+	spareW0 = f->spareW - ld;
 	
 	//	Having taken care of ordering issues, we can treat a visited permutation after 1 wasted character as an extra wasted character
 	
-	if (ld==1 && !unvisited[ndz->nextPerm]) spareW0--;
+	if (ld==1 && VISITED(visited,ndz->nextRank)) spareW0--;
 		
 	if (spareW0<0) break;
 	
 	curstr[pos] = ndz->digit;
-	tperm = ndz->fullNum;
+	rank = ndz->fullRank;
 	
-	int vperm = (ld==0);
-	if (vperm && unvisited[tperm])
+	vperm = (ld==0);
+	if (vperm && !VISITED(visited,rank))
 		{
-		if (pfound+1>max_perm)
+		//	Other threads can increase max_perm at any time, so we only compare with it while holding the lock
+		
+		if (f->pfound+1>=max_perm)
 			{
-			writeCurrentString(TRUE,pos+1);
-			nBest[tot_bl]=1;
-			bestLen[tot_bl]=pos+1;
-			deltaMaxPerm = pfound+1-max_perm;
-			max_perm = pfound+1;
-			printf("[Found a string that increased max_perm to %d]\n",max_perm);
-			maybeUpdateLowerBound(tperm,pos+1,tot_bl,max_perm);
-			if (oneExample && max_perm+1 >= mperm_ruledOut[tot_bl])
+			pthread_mutex_lock(&resultLock);
+			if (f->pfound+1>max_perm)
+				{
+				nBest[tot_bl] = writeCurrentString(ss,TRUE,pos+1);
+				bestLen[tot_bl]=pos+1;
+				f->deltaMaxPerm = f->pfound+1-max_perm;
+				max_perm = f->pfound+1;
+				printf("[Found a string that increased max_perm to %d]\n",max_perm);
+				maybeUpdateLowerBound(ss,rank,pos+1,tot_bl,max_perm);
+				if (historyOn) recordHistory(curstr,pos);
+				if (oneExample && max_perm+1 >= mperm_ruledOut[tot_bl])
+					{
+					printf("[Search is done]\n");
+					searchDone=TRUE;
+					ss->fallBackTo=-1;
+					pthread_mutex_unlock(&resultLock);
+					goto leaveNode;
+					};
+				}
+			else if (f->pfound+1==max_perm)
 				{
-				printf("[Search is done]\n");
-				fallBackTo=-1;
-				return;
+				nBest[tot_bl] += writeCurrentString(ss,nBest[tot_bl]==0,pos+1);
+				maybeUpdateLowerBound(ss,rank,pos+1,tot_bl,max_perm);
 				};
-			}
-		else if (pfound+1==max_perm)
-			{
-			writeCurrentString(nBest[tot_bl]==0,pos+1);
-			maybeUpdateLowerBound(tperm,pos+1,tot_bl,max_perm);
-			nBest[tot_bl]++;
+			pthread_mutex_unlock(&resultLock);
 			};
 
-		unvisited[tperm]=FALSE;
-		if (ocpTrackingOn)
-			{
-			int prevC=0, oc=0;
-			oc=oneCycleIndices[tperm];
-			prevC = oneCycleCounts[oc]--;
-			oneCycleBins[prevC]--;
-			oneCycleBins[prevC-1]++;
+		//	Visit the permutation and descend to the next level
 		
-			dvals[pos+1]=10000;
-			fillStr(pos+1, pfound+1, ndz->nextPart, TRUE);
-		
-			oneCycleBins[prevC-1]--;
-			oneCycleBins[prevC]++;
-			oneCycleCounts[oc]=prevC;
-			}
-		else
+		SET_VISITED(visited,rank);
+		ss->visitLog[ss->nVisitLog++]=rank;
+		if (ocpTrackingOn)
 			{
-			dvals[pos+1]=10000;
-			fillStr(pos+1, pfound+1, ndz->nextPart, TRUE);
+			VISIT_CYCLE(ss,rank)
 			};
-		unvisited[tperm]=TRUE;
+		
+		f->rank = rank;
+		ss->zHash[pos+1] = ss->zHash[pos] ^ zobrist[rank];
+		dvals[pos+1]=10000;
+		f[1].pfound = f->pfound+1;
+		f[1].partNum = ndz->nextPart;
+		f[1].leftPerm = TRUE;
+		f[1].mirrorDecided = f->mirrorDecided || (2*pos > mirrorLen+n-2 && !permWindowN(curstr,mirrorLen+n-2-pos,n));
+		pos++;
+		f++;
+		goto enterNode;
 		}
-	else if	(spareW > 0)
+	else if	(f->spareW > 0)
 		{
 		if (vperm)
 			{
-			if (allowRepeats) deferredRepeat=TRUE;
-			swap12 = !unvisited[nd[1].nextPerm];
+			if (allowRepeats) f->deferredRepeat=TRUE;
+			f->swap12 = VISITED(visited,nd[1].nextRank);
 			}
 		else
 			{
-			int d = pruneOnPerms(spareW0, pfound - max_perm);
+			//	If we are past the middle of the string, and it is not yet known to be in canonical orientation, it can't be if
+			//	the matching window in the first half was a permutation; the same goes for all the remaining choices.
+			
+			if (!f->mirrorDecided && 2*pos > mirrorLen+n-2 && permWindowN(curstr,mirrorLen+n-2-pos,n))
+				{
+				COUNT_STAT(ss,STAT_CUT_MIRROR,pos)
+				break;
+				};
+				
+			d = pruneOnPermsN(ss, spareW0, f->pfound - max_perm, n);
 			if	(
 				(oneExample && d > 0) || (allExamples && d >= 0)
 				)
 				{
+				f->rank = -1;
+				ss->zHash[pos+1] = ss->zHash[pos];
 				dvals[pos+1]=d;
-				fillStr(pos+1, pfound, ndz->nextPart, FALSE);
-				}
-			else break;
+				f[1].pfound = f->pfound;
+				f[1].partNum = ndz->nextPart;
+				f[1].leftPerm = FALSE;
+				f[1].mirrorDecided = f->mirrorDecided;
+				pos++;
+				f++;
+				goto enterNode;
+				};
+			#if SEARCH_STATS
+				COUNT_STAT(ss,ss->cutSource,pos)
+			#endif
+			break;
 			};
 		};
 	};
@@ -828,218 +1655,1777 @@ for	(int y=0; y<nm; y++)
 //	If we encountered a choice that led to a repeat visit to a permutation, we follow (or prune) that branch now.
 //	It will always come from the FIRST choice in the original list, as that is where any valid permutation must be.
 	
-if (deferredRepeat)
+if (f->deferredRepeat)
 	{
-	int d = pruneOnPerms(spareW-1, pfound - max_perm);
+	d = pruneOnPermsN(ss, f->spareW-1, f->pfound - max_perm, n);
 	if	(
 		(oneExample && d > 0) || (allExamples && d >= 0)
 		)
 		{
 		curstr[pos] = nd->digit;
+		ss->zHash[pos+1] = ss->zHash[pos];
 		dvals[pos+1]=d;
-		fillStr(pos+1, pfound, nd->nextPart, TRUE);
+		f->phase = PHASE_DEFERRED;
+		f[1].pfound = f->pfound;
+		f[1].partNum = nd->nextPart;
+		f[1].leftPerm = TRUE;
+		f[1].mirrorDecided = f->mirrorDecided || (2*pos > mirrorLen+n-2 && !permWindowN(curstr,mirrorLen+n-2-pos,n));
+		pos++;
+		f++;
+		goto enterNode;
 		};
+	#if SEARCH_STATS
+		COUNT_STAT(ss,ss->cutSource,pos)
+	#endif
 	};
 
-if (deltaMaxPerm && fallBackTo > 0)
+afterDeferred:
+
+if (f->deltaMaxPerm && ss->fallBackTo > 0)
 	{
-	printf("[level=%d, deltaMaxPerm=%d]\n",pos,deltaMaxPerm);
-	for (int i=n+1;i<=pos;i++) dvals[i]-=deltaMaxPerm;
+	printf("[level=%d, deltaMaxPerm=%d]\n",pos,f->deltaMaxPerm);
+	for (int i=n+1;i<=pos;i++) dvals[i]-=f->deltaMaxPerm;
 	for (int i=n+1;i<pos;i++)
 		{
 		if ((oneExample && dvals[i]<=0) || (allExamples && dvals[i] <0))
 			{
-			fallBackTo = i-1;
-			printf("[Fall back from level %d to level %d]\n",pos,fallBackTo);
+			ss->fallBackTo = i-1;
+			printf("[Fall back from level %d to level %d]\n",pos,ss->fallBackTo);
+			break;
+			};
+		};
+	};
+
+finishNode:
+
+//	If we have searched the whole subtree without finding a string, record that in the transposition table, in the slot in
+//	the bucket that already holds this state, or else in place of the entry with the fewest characters to spare
+
+if (ttActive && f->spareW + TT_MAX_WASTED >= tot_bl && ss->ttMark[pos]==ss->ttEvents)
+	{
+	uint64_t key = ttKey(ss,pos,f);
+	struct ttEntry *b = ttTable + TT_BUCKET*(key & ttMask);
+	uint64_t data = (allExamples ? max_perm : max_perm+1) | ((uint64_t)f->spareW << 32);
+	int r = 0;
+	for (int i=0;i<TT_BUCKET;i++)
+		{
+		if ((b[i].check ^ b[i].data)==key)
+			{
+			r = i;
 			break;
 			};
+		if ((b[i].data>>32) < (b[r].data>>32)) r = i;
+		};
+	b[r].data = data;
+	b[r].check = key ^ data;
+	};
+
+leaveNode:
+
+//	We are finished with the node at level pos, so we return to its parent
+
+if (pos==pos0) return;
+pos--;
+f--;
+
+if (f->phase==PHASE_DEFERRED) goto afterDeferred;
+
+//	Unvisit any permutation the parent visited with the choice we just finished exploring, then move on to its next choice
+
+if (f->rank>=0)
+	{
+	if (ocpTrackingOn)
+		{
+		UNVISIT_CYCLE(ss,f->rank)
 		};
+	ss->nVisitLog--;
+	CLEAR_VISITED(visited,f->rank);
 	};
+f->y++;
+nd = nextDigits + DS_ROW*f->partNum;
+goto nextChoice;
 }
 
 //	Version that fills in the string when we are following a previously computed best string
 //	rather than trying all digits.
+//
+//	There is only ever one way to continue from each position, so we just step along the template until it ends
+//	or we can go no further, then unvisit everything we visited on the way.
+//
+//	The template is the len digits that follow the first n digits of the packed string bestStr.
 
-void fillStr2(int pos, int pfound, int partNum, char *remapDigits, char *bestStr, int len)
+KERNEL void fillStr2N(struct searchState *ss, int pos, int pfound, int partNum, char *remapDigits, uint8_t *bestStr, int len,
+	const int n)
 {
-if (len<=0) return;		//	No more digits left in the template we are following
+char *curstr = ss->curstr;
+uint64_t *visited = ss->visited;
+int mark = ss->nVisitLog;
 
-int j1;
-int tperm;
-int alreadyWasted = pos - pfound - n + 1;
+//	We step through the packed digits with a buffer of bits taken from successive groups of 4 bytes
 
-j1 = remapDigits[*bestStr];	//	Get the next digit from the template, remapped to make it start at our chosen permutation
+int b = n*DBITS;
+uint8_t *bp = bestStr + (b>>3);
+uint64_t bits = PACKED_WORD(bp) >> (b&7);
+int nbits = 32 - (b&7);
+bp += 4;
 
-// there is never any benefit to having 2 of the same character next to each other
-	
-if	(j1 != curstr[pos-1])
+for (; len>0; len--, pos++)
 	{
+	int alreadyWasted = pos - pfound - n + 1;
+	
+	if (nbits < DBITS)
+		{
+		bits |= PACKED_WORD(bp) << nbits;
+		bp += 4;
+		nbits += 32;
+		};
+	int j1 = remapDigits[UNPACK_DIGIT(bits & ((1<<DBITS)-1))];	//	Get the next digit from the template, remapped to make it start at our chosen permutation
+	bits >>= DBITS;
+	nbits -= DBITS;
+
+	// there is never any benefit to having 2 of the same character next to each other
+	
+	if (j1 == curstr[pos-1]) break;
+	
 	curstr[pos] = j1;
-	tperm = partNum + (j1<<nmbits);
+	struct digitScore *ds = nextDigits + DS_ROW*partNum + digitSlot[DS_ROW*partNum+j1-1];
+	partNum = ds->nextPart;
 
 	// Check to see if this contributes a new permutation or not
 	
-	int vperm = valid[tperm];
+	int vperm = (ds->score==0);
+	int rank = ds->fullRank;
 
-	// now go to the next level of the recursion
+	// now go on to the next position
 	
-	if (vperm && unvisited[tperm])
+	if (vperm && !VISITED(visited,rank))
 		{
-		if (pfound+1>max_perm)
-			{
-			printf("Reached a point in the code that should be impossible!\n");
-			exit(EXIT_FAILURE);
-			}
-		else if (pfound+1==max_perm)
+		if (pfound+1>=max_perm)
 			{
-			writeCurrentString(nBest[tot_bl]==0,pos+1);
-			maybeUpdateLowerBound(tperm,pos+1,tot_bl,max_perm);
-			nBest[tot_bl]++;
+			pthread_mutex_lock(&resultLock);
+			if (pfound+1>max_perm)
+				{
+				printf("Reached a point in the code that should be impossible!\n");
+				exit(EXIT_FAILURE);
+				}
+			else if (pfound+1==max_perm)
+				{
+				nBest[tot_bl] += writeCurrentString(ss,nBest[tot_bl]==0,pos+1);
+				maybeUpdateLowerBound(ss,rank,pos+1,tot_bl,max_perm);
+				};
+			pthread_mutex_unlock(&resultLock);
 			};
 			
-		unvisited[tperm]=FALSE;
+		SET_VISITED(visited,rank);
+		ss->visitLog[ss->nVisitLog++]=rank;
 		if (ocpTrackingOn)
 			{
-			int prevC=0, oc=0;
-			oc=oneCycleIndices[tperm];
-			prevC = oneCycleCounts[oc]--;
-			oneCycleBins[prevC]--;
-			oneCycleBins[prevC-1]++;
-		
-			fillStr2(pos+1, pfound+1, tperm>>DBITS, remapDigits, bestStr+1, len-1);
-		
-			oneCycleBins[prevC-1]--;
-			oneCycleBins[prevC]++;
-			oneCycleCounts[oc]=prevC;
-			}
-		else
-			{
-			fillStr2(pos+1, pfound+1, tperm>>DBITS, remapDigits, bestStr+1, len-1);
+			VISIT_CYCLE(ss,rank)
 			};
-		unvisited[tperm]=TRUE;
+		pfound++;
 		}
-	else if	(alreadyWasted < tot_bl)
-		{
-		if	(((!vperm) || allowRepeats) && pruneOnPerms(tot_bl - (alreadyWasted+1), pfound - max_perm) >=0)
-			{
-			fillStr2(pos+1, pfound, tperm>>DBITS, remapDigits, bestStr+1, len-1);
-			};
-		};
+	else if	(!(alreadyWasted < tot_bl
+			&& ((!vperm) || allowRepeats) && pruneOnPermsN(ss, tot_bl - (alreadyWasted+1), pfound - max_perm, n) >=0)) break;
 	};
-}
-
-// this function computes the factorial of a number
 
-int fac(int k)
-{
-if (k <= 1) return 1;
-else return k*fac(k-1);
+unvisitTo(ss, mark);
 }
 
-//	Generate all permutations of 1 ... n;
-//	generates lists for lower values of n
-//	in the process.
+//	Version of fillStr2N() that follows all the best strings at once, using a trie that holds the digits that
+//	follow the first n of each string.
+//
+//	Every string that shares a given prefix leads to the same state when we follow that prefix, so we only need
+//	to explore each node of the trie once, and when we can go no further from a node we have dealt with every string
+//	that passes through it.
 
-void makePerms(int n, int **permTab)
+KERNEL void fillStrTrieN(struct searchState *ss, int pos, int pfound, int partNum, char *remapDigits, uint32_t *trie, int nNodes,
+	const int n)
 {
-int fn=fac(n);
-int size=n*fn;
-int *res;
+char *curstr = ss->curstr;
+uint64_t *visited = ss->visited;
+struct trieFrame *tf = ss->trieFrames;
 
-CHECK_MEM( res=(int *)malloc(size*sizeof(int)) )
+tf->node = 0;
+tf->end = nNodes;
+tf->pos = pos;
+tf->pfound = pfound;
+tf->partNum = partNum;
 
-if (n==1)
-	{
-	res[0]=1;
-	}
-else
+while (TRUE)
 	{
-	makePerms(n-1, permTab-1);
-	int *prev=*(permTab-1);
-	int p=0;
-	int pf=fac(n-1);
-	for (int k=0;k<pf;k++)
+	//	When we have tried all the children of a node, return to its parent and move on to the parent's next child
+	
+	if (tf->node >= tf->end)
 		{
-		for (int q=n-1;q>=0;q--)
+		if (tf==ss->trieFrames) break;
+		tf--;
+		unvisitTo(ss, tf->mark);
+		tf->node = trie[tf->node]>>DBITS;
+		continue;
+		};
+		
+	pos = tf->pos;
+	pfound = tf->pfound;
+	tf->mark = ss->nVisitLog;
+	
+	int alreadyWasted = pos - pfound - n + 1;
+	int j1 = remapDigits[UNPACK_DIGIT(trie[tf->node] & ((1<<DBITS)-1))];	//	Get the next digit from the trie, remapped to make it start at our chosen permutation
+
+	// there is never any benefit to having 2 of the same character next to each other
+	
+	if (j1 == curstr[pos-1])
+		{
+		tf->node = trie[tf->node]>>DBITS;
+		continue;
+		};
+	
+	curstr[pos] = j1;
+	struct digitScore *ds = nextDigits + DS_ROW*tf->partNum + digitSlot[DS_ROW*tf->partNum+j1-1];
+	partNum = ds->nextPart;
+
+	// Check to see if this contributes a new permutation or not
+	
+	int vperm = (ds->score==0);
+	int rank = ds->fullRank;
+
+	// now go on to the next position
+	
+	if (vperm && !VISITED(visited,rank))
+		{
+		if (pfound+1>=max_perm)
 			{
-			int r=0;
-			for (int s=0;s<n;s++)
+			pthread_mutex_lock(&resultLock);
+			if (pfound+1>max_perm)
 				{
-				if (s==q) res[p++]=n;
-				else res[p++]=prev[k*(n-1)+(r++)];
+				printf("Reached a point in the code that should be impossible!\n");
+				exit(EXIT_FAILURE);
+				}
+			else if (pfound+1==max_perm)
+				{
+				nBest[tot_bl] += writeCurrentString(ss,nBest[tot_bl]==0,pos+1);
+				maybeUpdateLowerBound(ss,rank,pos+1,tot_bl,max_perm);
 				};
+			pthread_mutex_unlock(&resultLock);
+			};
+			
+		SET_VISITED(visited,rank);
+		ss->visitLog[ss->nVisitLog++]=rank;
+		if (ocpTrackingOn)
+			{
+			VISIT_CYCLE(ss,rank)
 			};
+		pfound++;
+		}
+	else if	(!(alreadyWasted < tot_bl
+			&& ((!vperm) || allowRepeats) && pruneOnPermsN(ss, tot_bl - (alreadyWasted+1), pfound - max_perm, n) >=0))
+		{
+		tf->node = trie[tf->node]>>DBITS;
+		continue;
 		};
+		
+	//	Move on to the children of this node
+		
+	tf[1].node = tf->node+1;
+	tf[1].end = trie[tf->node]>>DBITS;
+	tf[1].pos = pos+1;
+	tf[1].pfound = pfound;
+	tf[1].partNum = partNum;
+	tf++;
 	};
-
-*permTab = res;
 }
 
-void writeCurrentString(int newFile, int size)
-{
-FILE *fp;
-fp = fopen(outputFileName,newFile?"wt":"at");
-if (fp==NULL)
-	{
-	printf("Unable to open file %s to %s\n",outputFileName,newFile?"write":"append");
-	exit(EXIT_FAILURE);
-	};
-for (int k=0;k<size;k++) fprintf(fp,"%c",'0'+curstr[k]);
-fprintf(fp,"\n");
-fclose(fp);
-}
+//	Compile the list of best strings for w into a trie of the digits that follow the first n of each string.
+//
+//	The trie is stored in preorder, one 32-bit word per node, with the digit in the lowest DBITS bits and the index just past
+//	the node's subtree in the remaining bits; so the children of a node start straight after it, and each child's subtree is
+//	followed by the next child.  The children are in the order in which they first appear in the list.
+//
+//	Once we have the trie we no longer need the list itself.  If the trie would have too many nodes to index, we keep the list
+//	and follow the strings one at a time.
 
-void clearFlags(int tperm0)
+void buildTrie(int w)
 {
-for (int i=0; i<maxInt; i++) unvisited[i] = TRUE;
-unvisited[tperm0]=FALSE;
-}
+int len = bestLen[w];
+long int size = PACKED_SIZE(len);
 
-void readBackFile(FILE *fp, int w)
+//	Build the trie with links from each node to its first child and next sibling; node 0 is the root
+
+int maxNodes = 1024, nNodes = 1;
+int *child, *sibling;
+char *digit, *str;
+CHECK_MEM( child = (int *)malloc(maxNodes*sizeof(int)) )
+CHECK_MEM( sibling = (int *)malloc(maxNodes*sizeof(int)) )
+CHECK_MEM( digit = (char *)malloc(maxNodes*sizeof(char)) )
+CHECK_MEM( str = (char *)malloc(len*sizeof(char)) )
+child[0] = sibling[0] = -1;
+
+for (int i=0;i<nBest[w] && nNodes < (1<<(32-DBITS));i++)
+	{
+	unpackDigits(str, bestStrings[w]+i*size, len);
+	int node = 0;
+	for (int k=n;k<len;k++)
+		{
+		int c = child[node], last = -1;
+		while (c>=0 && digit[c]!=str[k])
+			{
+			last = c;
+			c = sibling[c];
+			};
+		if (c<0)
+			{
+			if (nNodes >= maxNodes)
+				{
+				maxNodes *= 2;
+				CHECK_MEM( child = (int *)realloc(child, maxNodes*sizeof(int)) )
+				CHECK_MEM( sibling = (int *)realloc(sibling, maxNodes*sizeof(int)) )
+				CHECK_MEM( digit = (char *)realloc(digit, maxNodes*sizeof(char)) )
+				};
+			c = nNodes++;
+			digit[c] = str[k];
+			child[c] = sibling[c] = -1;
+			if (last<0) child[node] = c; else sibling[last] = c;
+			};
+		node = c;
+		};
+	};
+	
+//	Write the nodes out in preorder, with an explicit stack of the nodes we are working through at each depth
+
+if (nNodes < (1<<(32-DBITS)))
+	{
+	int *stackNode, *stackOut;
+	CHECK_MEM( stackNode = (int *)malloc((len+2)*sizeof(int)) )
+	CHECK_MEM( stackOut = (int *)malloc((len+2)*sizeof(int)) )
+	CHECK_MEM( bestTrie[w] = (uint32_t *)malloc(nNodes*sizeof(uint32_t)) )
+	uint32_t *trie = bestTrie[w];
+	
+	int top = 0, p = 0;
+	stackNode[0] = child[0];
+	while (top>=0)
+		{
+		int c = stackNode[top];
+		if (c<0)
+			{
+			if (--top>=0)
+				{
+				trie[stackOut[top]] |= p<<DBITS;
+				stackNode[top] = sibling[stackNode[top]];
+				};
+			}
+		else
+			{
+			stackOut[top] = p;
+			trie[p++] = PACK_DIGIT(digit[c]);
+			stackNode[++top] = child[c];
+			};
+		};
+	nTrie[w] = p;
+	free(stackNode);
+	free(stackOut);
+	freeBestStrings(w);
+	};
+	
+free(child);
+free(sibling);
+free(digit);
+free(str);
+}
+
+//	Search the whole tree for the current values of tot_bl and max_perm, using all the threads
+
+void searchAll(int partNum0)
+{
+struct task **tasks;
+int nTasks;
+
+searchDone = FALSE;
+for (int i=0;i<nThreads;i++) states[i].fallBackTo = 2*fn;
+
+//	We can only rule out strings by their orientation if we know their length.  If max_perm can't increase, and the strings
+//	need all tot_bl wasted characters to visit max_perm permutations, that will be bestLen[tot_bl].
+
+mirrorLen = noMirrors && allExamples && (max_perm+1 >= mperm_ruledOut[tot_bl] || max_perm >= fn) && max_perm > mperm_res[tot_bl-1]
+	? bestLen[tot_bl] : 0;
+
+//	What we record in the transposition table depends only on the state at each node, not on the rest of the string, so it
+//	holds good from one search to the next; but when we are ruling out strings by their orientation, it does depend on that.
+
+ttActive = ttTable!=NULL && !mirrorLen;
+
+if (resumeW)
+	{
+	//	Pick up from the checkpoint
+	
+	tasks = resumeTasks;
+	nTasks = nResumeTasks;
+	resumeTasks = NULL;
+	nResumeTasks = 0;
+	resumeW = 0;
+	}
+else
+	{
+	//	Split the tree one level at a time, replacing each task with tasks for the subtrees of its children
+	//	(in the same order that a single thread would explore them), until we have enough tasks to share out
+	
+	struct searchState *ss = states;
+	struct frame *f = ss->frames+n;
+	f->pfound = 1;
+	f->partNum = partNum0;
+	f->leftPerm = TRUE;
+	f->mirrorDecided = !mirrorLen;
+	
+	CHECK_MEM( tasks = (struct task **)malloc(sizeof(struct task *)) )
+	tasks[0] = makeTask(ss, n, n);
+	nTasks = 1;
+	
+	for (int level=0; nThreads>1 && level<MAX_SPLIT_LEVELS && nTasks>0 && nTasks<TASKS_PER_THREAD*nThreads && !searchDone; level++)
+		{
+		ss->split = NULL;
+		ss->nSplit = ss->maxSplit = 0;
+		for (int i=0;i<nTasks;i++)
+			{
+			ss->splitPos = tasks[i]->pos+1;
+			if (!searchDone) runTask(ss, tasks[i]);
+			free(tasks[i]);
+			};
+		free(tasks);
+		tasks = ss->split;
+		nTasks = ss->nSplit;
+		ss->split = NULL;
+		};
+	ss->splitPos = 2*fn+1;
+	};
+	
+//	Deal the tasks out to the threads' queues in turn, so that all threads start near the front of the search
+
+for (int i=0;i<nThreads;i++)
+	{
+	struct taskDeque *dq = &states[i].deque;
+	CHECK_MEM( dq->tasks = (struct task **)realloc(dq->tasks, (nTasks/nThreads+1)*sizeof(struct task *)) )
+	dq->head = dq->tail = 0;
+	};
+for (int i=0;i<nTasks;i++)
+	{
+	struct taskDeque *dq = &states[i%nThreads].deque;
+	dq->tasks[dq->tail++] = tasks[i];
+	};
+free(tasks);
+
+//	The main thread works through the queue for states[0], while other threads deal with the rest
+
+nRunning = nThreads;
+nParked = 0;
+
+pthread_t threads[MAX_THREADS];
+for (int i=1;i<nThreads;i++)
+	{
+	if (pthread_create(threads+i, NULL, workerThread, states+i) != 0)
+		{
+		printf("Unable to create thread %d\n",i);
+		exit(EXIT_FAILURE);
+		};
+	};
+workerThread(states);
+for (int i=1;i<nThreads;i++) pthread_join(threads[i], NULL);
+
+//	Make sure every thread's state is back to having visited only the first permutation, ready for the next search
+
+for (int i=0;i<nThreads;i++)
+	{
+	unvisitTo(states+i, 1);
+	nodeCount += states[i].nodeCount;
+	prunedOCP += states[i].prunedOCP;
+	prunedParity += states[i].prunedParity;
+	ttCuts += states[i].ttCuts;
+	states[i].nodeCount = 0;
+	states[i].prunedOCP = 0;
+	states[i].prunedParity = 0;
+	states[i].ttCuts = 0;
+	#if SEARCH_STATS
+		for (int p=0;p<2*fn+2;p++)
+		for (int k=0;k<N_STATS;k++)
+			{
+			statsTotal[p][k] += states[i].stats[p][k];
+			states[i].stats[p][k] = 0;
+			};
+	#endif
+	};
+}
+
+//	Create a task for the subtree at level pos0 of a thread's search, which the thread has searched down to the node at level pos
+
+struct task *makeTask(struct searchState *ss, int pos0, int pos)
+{
+struct task *tsk;
+int nf = pos-pos0+1;
+
+//	Allocate a single block for the structure, the frames, the discriminant values and the prefix
+
+CHECK_MEM( tsk = (struct task *)malloc(sizeof(struct task) + nf*sizeof(struct frame) + (pos+1)*sizeof(int) + pos*sizeof(char)) )
+tsk->pos = pos0;
+tsk->depth = pos;
+tsk->fallBackTo = ss->fallBackTo;
+tsk->frames = (struct frame *)(tsk+1);
+tsk->dvals = (int *)(tsk->frames+nf);
+tsk->prefix = (char *)(tsk->dvals+pos+1);
+memcpy(tsk->frames, ss->frames+pos0, nf*sizeof(struct frame));
+memcpy(tsk->dvals, ss->dvals, (pos+1)*sizeof(int));
+memcpy(tsk->prefix, ss->curstr, pos*sizeof(char));
+return tsk;
+}
+
+//	Queue the current node as a task, when splitting the tree
+
+void splitTask(struct searchState *ss, int pos)
+{
+if (ss->nSplit >= ss->maxSplit)
+	{
+	ss->maxSplit = 2*ss->maxSplit + 64;
+	CHECK_MEM( ss->split = (struct task **)realloc(ss->split, ss->maxSplit*sizeof(struct task *)) )
+	};
+ss->split[ss->nSplit++] = makeTask(ss, pos, pos);
+}
+
+//	Explore the subtree for a task, first replaying its prefix to bring the thread's state into line with it
+
+void runTask(struct searchState *ss, struct task *tsk)
+{
+int pos = tsk->depth;
+memcpy(ss->curstr, tsk->prefix, pos*sizeof(char));
+memcpy(ss->dvals, tsk->dvals, (pos+1)*sizeof(int));
+memcpy(ss->frames+tsk->pos, tsk->frames, (pos-tsk->pos+1)*sizeof(struct frame));
+
+//	Visit the permutations in the prefix (the first, 123...n, is always flagged as visited).
+//
+//	For a task that was already partly explored, this includes the permutations visited at each level between the root of
+//	the subtree and the node where the search starts; as we visit them in order of their position in the string, they end
+//	up in the visit log in the same order they would have been if we had descended to that node in the usual way.
+
+int mark = ss->nVisitLog;
+uint64_t h = 0;
+for (int i=0;i<mark;i++) h ^= zobrist[ss->visitLog[i]];
+for (int j=n;j<pos;j++)
+	{
+	ss->zHash[j] = h;
+	int rank = windowRank(ss->curstr, j);
+	if (rank>=0 && !VISITED(ss->visited,rank))
+		{
+		SET_VISITED(ss->visited,rank);
+		ss->visitLog[ss->nVisitLog++]=rank;
+		h ^= zobrist[rank];
+		if (ocpTrackingOn)
+			{
+			VISIT_CYCLE(ss,rank)
+			};
+		};
+	};
+ss->zHash[pos] = h;
+
+//	The levels above the node where the search starts were already partly explored, so we can never record them as hopeless
+
+for (int j=tsk->pos;j<pos;j++) ss->ttMark[j] = ss->ttEvents;
+if (pos > tsk->pos) ss->ttEvents++;
+
+ss->fallBackTo = tsk->fallBackTo;
+ss->task = tsk;
+fillStr(ss, tsk->pos, pos);
+ss->task = NULL;
+
+//	Restore the state we had before replaying the prefix
+
+unvisitTo(ss, mark);
+}
+
+//	Get the next task for a thread, from its own queue if possible, otherwise stolen from another thread's queue;
+//	returns NULL when there are no tasks left anywhere
+
+struct task *nextTask(struct searchState *ss)
+{
+struct task *tsk=NULL;
+
+struct taskDeque *dq = &ss->deque;
+pthread_mutex_lock(&dq->lock);
+if (dq->head < dq->tail) tsk = dq->tasks[dq->head++];
+pthread_mutex_unlock(&dq->lock);
+
+for (int k=1;k<nThreads && tsk==NULL;k++)
+	{
+	dq = &states[(ss->id+k)%nThreads].deque;
+	pthread_mutex_lock(&dq->lock);
+	if (dq->head < dq->tail) tsk = dq->tasks[--dq->tail];
+	pthread_mutex_unlock(&dq->lock);
+	};
+return tsk;
+}
+
+//	Work through tasks until none are left; once the search is done, remaining tasks are just discarded
+
+void *workerThread(void *arg)
+{
+struct searchState *ss = (struct searchState *)arg;
+struct task *tsk;
+while (TRUE)
+	{
+	if (checkpointRequested) parkForCheckpoint(ss, -1);
+	if ((tsk=nextTask(ss)) == NULL) break;
+	if (!searchDone) runTask(ss, tsk);
+	free(tsk);
+	};
+	
+//	If the other threads are all waiting for this one to pause for a checkpoint, it falls to us to release them
+
+pthread_mutex_lock(&checkpointLock);
+nRunning--;
+if (checkpointRequested && nRunning>0 && nParked==nRunning) releaseCheckpoint();
+pthread_mutex_unlock(&checkpointLock);
+return NULL;
+}
+
+//	See if it is time to take a checkpoint; any thread can call this, and all it does is make the request
+
+void checkClock(void)
+{
+if (!checkpointRequested && time(NULL) >= nextCheckpoint) checkpointRequested = TRUE;
+}
+
+//	Pause a thread for a checkpoint, at level pos of its current task, or between tasks if pos is -1.
+//
+//	The last thread to pause writes the checkpoint, then releases all the others.
+
+void parkForCheckpoint(struct searchState *ss, int pos)
+{
+pthread_mutex_lock(&checkpointLock);
+if (checkpointRequested)
+	{
+	ss->parkedPos = pos;
+	nParked++;
+	if (nParked==nRunning) releaseCheckpoint();
+	else
+		{
+		int gen = checkpointGen;
+		while (gen==checkpointGen) pthread_cond_wait(&checkpointCond, &checkpointLock);
+		};
+	ss->parkedPos = -1;
+	};
+pthread_mutex_unlock(&checkpointLock);
+}
+
+//	Write the checkpoint, then let all the paused threads continue; the caller must hold checkpointLock
+
+void releaseCheckpoint(void)
+{
+writeCheckpoint();
+checkpointRequested = FALSE;
+nParked = 0;
+checkpointGen++;
+nextCheckpoint = time(NULL) + 60*checkpointMinutes;
+pthread_cond_broadcast(&checkpointCond);
+}
+
+//	Write everything we need to resume the current search to the checkpoint file.
+//
+//	All threads are paused, either at a node in their current task or between tasks, so nothing we save here can change.
+//	We write to a temporary file first, so that if we are halted part-way through, the previous checkpoint remains intact.
+
+void writeCheckpoint(void)
+{
+char tmpName[300];
+sprintf(tmpName,"%s.tmp",checkpointFileName);
+FILE *fp = fopen(tmpName,"wb");
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to write\n",tmpName);
+	return;
+	};
+	
+//	Once the output file is flushed, its length marks the strings found so far
+
+long int outLen = 0;
+if (outputFile!=NULL) fflush(outputFile);
+FILE *fo = fopen(outputFileName,"rb");
+if (fo!=NULL)
+	{
+	fseek(fo, 0, SEEK_END);
+	outLen = ftell(fo);
+	fclose(fo);
+	};
+
+//	Threads paused at a node have already counted it, but will count it again when the search resumes
+
+unsigned long int totalNodes = nodeCount;
+long int totalPruned = prunedOCP, totalPrunedParity = prunedParity;
+for (int i=0;i<nThreads;i++)
+	{
+	totalNodes += states[i].nodeCount;
+	totalPruned += states[i].prunedOCP;
+	totalPrunedParity += states[i].prunedParity;
+	if (states[i].parkedPos>=0) totalNodes--;
+	};
+	
+int header[] = {CHECKPOINT_VERSION, (int)sizeof(struct frame), n, oneExample, noRepeats, noMirrors,
+	tot_bl, max_perm, nBest[tot_bl], bestLen[tot_bl], old_max, expectedInc};
+fwrite(CHECKPOINT_MAGIC, sizeof(char), strlen(CHECKPOINT_MAGIC), fp);
+fwrite(header, sizeof(int), sizeof(header)/sizeof(int), fp);
+fwrite(&outLen, sizeof(long int), 1, fp);
+fwrite(&totalNodes, sizeof(unsigned long int), 1, fp);
+fwrite(&totalPruned, sizeof(long int), 1, fp);
+fwrite(&totalPrunedParity, sizeof(long int), 1, fp);
+fwrite(mperm_res, sizeof(int), maxW, fp);
+fwrite(mperm_ruledOut, sizeof(int), maxW, fp);
+fwrite(klbLen, sizeof(int), maxW, fp);
+for (int i=0;i<maxW;i++) if (klbLen[i]>0) fwrite(klbStrings[i], sizeof(uint8_t), PACKED_SIZE(klbLen[i]), fp);
+
+//	The tasks that are under way come first, followed by those still queued, in the order each thread would take them
+
+int nTasks = 0, maxQueued = 0;
+for (int i=0;i<nThreads;i++)
+	{
+	int q = states[i].deque.tail - states[i].deque.head;
+	if (states[i].parkedPos>=0) nTasks++;
+	nTasks += q;
+	if (q > maxQueued) maxQueued = q;
+	};
+fwrite(&nTasks, sizeof(int), 1, fp);
+
+for (int i=0;i<=maxQueued;i++)
+	{
+	struct task *tsk;
+	for (int k=0;k<nThreads;k++)
+		{
+		struct searchState *ss = states+k;
+		if (i==0)
+			{
+			if (ss->parkedPos<0) continue;
+			tsk = makeTask(ss, ss->task->pos, ss->parkedPos);
+			}
+		else
+			{
+			if (ss->deque.head+i-1 >= ss->deque.tail) continue;
+			tsk = ss->deque.tasks[ss->deque.head+i-1];
+			};
+		int dims[] = {tsk->pos, tsk->depth, tsk->fallBackTo};
+		fwrite(dims, sizeof(int), 3, fp);
+		fwrite(tsk->frames, sizeof(struct frame), tsk->depth-tsk->pos+1, fp);
+		fwrite(tsk->dvals, sizeof(int), tsk->depth+1, fp);
+		fwrite(tsk->prefix, sizeof(char), tsk->depth, fp);
+		if (i==0) free(tsk);
+		};
+	};
+	
+int ok = (fflush(fp)==0 && !ferror(fp));
+fclose(fp);
+if (ok && rename(tmpName, checkpointFileName)==0)
+	{
+	printf("[Checkpoint for w=%d, max_perm=%d, %d tasks (%lu calls)]\n",tot_bl,max_perm,nTasks,totalNodes);
+	#if SEARCH_STATS
+		writeStats(statsCPFileName, "wt", tot_bl, TRUE);
+	#endif
+	}
+else printf("Unable to write checkpoint file %s\n",checkpointFileName);
+}
+
+#if SEARCH_STATS
+
+//	Write the counts of events at each depth for the search with w wasted characters to a CSV file, skipping depths
+//	where nothing happened.  If partial is TRUE, the search is paused for a checkpoint, and we include the counts
+//	held by each thread, less the nodes the paused threads will count again when the search resumes.
+
+void writeStats(const char *fileName, const char *mode, int w, int partial)
+{
+FILE *fp = fopen(fileName,mode);
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to write\n",fileName);
+	return;
+	};
+fseek(fp, 0, SEEK_END);
+if (ftell(fp)==0) fprintf(fp,STATS_CSV_HEADER);
+
+for (int p=0;p<2*fn+2;p++)
+	{
+	long int row[N_STATS];
+	int any = FALSE;
+	for (int k=0;k<N_STATS;k++)
+		{
+		row[k] = statsTotal[p][k];
+		if (partial) for (int i=0;i<nThreads;i++) row[k] += states[i].stats[p][k];
+		};
+	if (partial) for (int i=0;i<nThreads;i++) if (states[i].parkedPos==p) row[STAT_NODES]--;
+	for (int k=0;k<N_STATS;k++) if (row[k]!=0) any = TRUE;
+	if (!any) continue;
+	
+	fprintf(fp,"%d,%d",w,p);
+	for (int k=0;k<N_STATS;k++) fprintf(fp,",%ld",row[k]);
+	fprintf(fp,"\n");
+	};
+fclose(fp);
+}
+
+//	Add the counts for the search with w wasted characters from a CSV file written by writeStats() to the totals
+
+void readStats(const char *fileName, int w)
+{
+FILE *fp = fopen(fileName,"rt");
+if (fp==NULL) return;
+
+char line[256];
+while (fgets(line, sizeof(line), fp)!=NULL)
+	{
+	int w1, p;
+	long int row[N_STATS];
+	if (sscanf(line,"%d,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld",&w1,&p,row,row+1,row+2,row+3,row+4,row+5,row+6,row+7)!=2+N_STATS) continue;
+	if (w1!=w || p<0 || p>=2*fn+2) continue;
+	for (int k=0;k<N_STATS;k++) statsTotal[p][k] += row[k];
+	};
+fclose(fp);
+}
+
+#endif
+
+//	Read back a checkpoint file, if there is one, restoring the state of the search to the point where the checkpoint was taken.
+//
+//	Returns the w value of the search to resume, or 0 if there is no valid checkpoint.
+
+int readCheckpoint(void)
+{
+FILE *fp = fopen(checkpointFileName,"rb");
+if (fp==NULL) return 0;
+
+char magic[sizeof(CHECKPOINT_MAGIC)];
+int header[12];
+long int outLen;
+int ok = fread(magic, sizeof(char), strlen(CHECKPOINT_MAGIC), fp)==strlen(CHECKPOINT_MAGIC)
+	&& strncmp(magic, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC))==0
+	&& fread(header, sizeof(int), 12, fp)==12
+	&& header[0]==CHECKPOINT_VERSION && header[1]==(int)sizeof(struct frame)
+	&& header[2]==n && header[3]==oneExample && header[4]==noRepeats && header[5]==noMirrors
+	&& header[6]>0 && header[6]<maxW;
+if (!ok)
+	{
+	printf("Ignoring checkpoint file %s, which does not match this version of the program and these options\n",checkpointFileName);
+	fclose(fp);
+	return 0;
+	};
+	
+int w = header[6];
+max_perm = header[7];
+nBest[w] = header[8];
+bestLen[w] = header[9];
+old_max = header[10];
+expectedInc = header[11];
+
+ok = fread(&outLen, sizeof(long int), 1, fp)==1
+	&& fread(&nodeCount, sizeof(unsigned long int), 1, fp)==1
+	&& fread(&prunedOCP, sizeof(long int), 1, fp)==1
+	&& fread(&prunedParity, sizeof(long int), 1, fp)==1
+	&& fread(mperm_res, sizeof(int), maxW, fp)==maxW
+	&& fread(mperm_ruledOut, sizeof(int), maxW, fp)==maxW
+	&& fread(klbLen, sizeof(int), maxW, fp)==maxW;
+for (int i=0;i<maxW && ok;i++) if (klbLen[i]>0)
+	{
+	if (klbStrings[i]==NULL) CHECK_MEM( klbStrings[i] = (uint8_t *)malloc(PACKED_SIZE(2*fn)*sizeof(uint8_t)) )
+	ok = fread(klbStrings[i], sizeof(uint8_t), PACKED_SIZE(klbLen[i]), fp)==PACKED_SIZE(klbLen[i]);
+	};
+ok = ok && fread(&nResumeTasks, sizeof(int), 1, fp)==1;
+
+CHECK_MEM( resumeTasks = (struct task **)malloc((nResumeTasks+1)*sizeof(struct task *)) )
+for (int i=0;i<nResumeTasks && ok;i++)
+	{
+	int dims[3];
+	ok = fread(dims, sizeof(int), 3, fp)==3;
+	if (!ok) break;
+	int pos0=dims[0], pos=dims[1], nf=pos-pos0+1;
+	struct task *tsk;
+	CHECK_MEM( tsk = (struct task *)malloc(sizeof(struct task) + nf*sizeof(struct frame) + (pos+1)*sizeof(int) + pos*sizeof(char)) )
+	tsk->pos = pos0;
+	tsk->depth = pos;
+	tsk->fallBackTo = dims[2];
+	tsk->frames = (struct frame *)(tsk+1);
+	tsk->dvals = (int *)(tsk->frames+nf);
+	tsk->prefix = (char *)(tsk->dvals+pos+1);
+	ok = fread(tsk->frames, sizeof(struct frame), nf, fp)==nf
+		&& fread(tsk->dvals, sizeof(int), pos+1, fp)==pos+1
+		&& fread(tsk->prefix, sizeof(char), pos, fp)==pos;
+	resumeTasks[i] = tsk;
+	};
+fclose(fp);
+
+if (!ok)
+	{
+	printf("The checkpoint file %s is incomplete\n",checkpointFileName);
+	exit(EXIT_FAILURE);
+	};
+	
+//	Discard any strings that were written to the output file after the checkpoint, as we will find them again
+
+sprintf(outputFileName,"Chaffin_%d_W_%d%s.txt",n,w,oneExample?"_OE":"");
+if (outLen==0) remove(outputFileName);
+else if (truncate(outputFileName, outLen)!=0)
+	{
+	printf("Unable to truncate file %s\n",outputFileName);
+	exit(EXIT_FAILURE);
+	};
+
+//	Pick up the list of strings that were found before the checkpoint
+
+#if KEEP_STRINGS
+	if (nBest[w]>0)
+		{
+		fp = fopen(outputFileName,"rt");
+		if (fp==NULL)
+			{
+			printf("Unable to open file %s to read\n",outputFileName);
+			exit(EXIT_FAILURE);
+			};
+		readBackFile(fp, w);
+		fclose(fp);
+		foundStrings = bestStrings[w];
+		bestStrings[w] = NULL;
+		nFoundBytes = nBest[w]*PACKED_SIZE(bestLen[w]);
+		maxFoundBytes = nFoundBytes+PACKED_PADDING;
+		};
+#endif
+
+printf("Read checkpoint file %s for w=%d, with %d tasks\n",checkpointFileName,w,nResumeTasks);
+return w;
+}
+
+//	Search for several values of max_perm at once, starting from the current value and working down, with each search
+//	run by a separate child process that uses all the threads we have been asked for.
+//
+//	A search that finds any strings gives us the final value of max_perm, along with all the strings that achieve it,
+//	so as soon as one succeeds we cancel the rest.  A search that fails rules out its own value of max_perm and all higher
+//	ones, so we cancel any searches for those values that are still running.
+//
+//	Returns TRUE if one of the searches succeeded, in which case the output file and all the results for this w are just as
+//	if we had found them in this process.  Otherwise max_perm is reduced to one less than the lowest value we tried.
+//
+//	Nodes searched by cancelled searches are not included in nodeCount.  Checkpoints are not taken during these searches.
+
+int speculativeSearch(int partNum0)
+{
+struct lane lanes[MAX_LANES];
+char finalFileName[256], laneFileName[300];
+int nLanes, nLeft, winner=-1;
+struct laneResult res;
+
+strcpy(finalFileName, outputFileName);
+
+//	Make sure nothing buffered is output twice, once by each child
+
+fflush(stdout);
+
+for (nLanes=0; nLanes<speculate && max_perm-nLanes>0; nLanes++)
+	{
+	struct lane *ln = lanes+nLanes;
+	ln->target = max_perm-nLanes;
+	ln->done = FALSE;
+	sprintf(laneFileName,"%s.%d",finalFileName,ln->target);
+	
+	int fds[2];
+	if (pipe(fds)!=0)
+		{
+		printf("Unable to create a pipe for the search with max_perm of %d\n",ln->target);
+		exit(EXIT_FAILURE);
+		};
+	pid_t parent = getpid();
+	ln->pid = fork();
+	if (ln->pid<0)
+		{
+		printf("Unable to create a process for the search with max_perm of %d\n",ln->target);
+		exit(EXIT_FAILURE);
+		};
+	if (ln->pid==0)
+		{
+		//	Where we can, make sure the child doesn't outlive us if we are halted
+		
+		#ifdef __linux__
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			if (getppid()!=parent) _exit(EXIT_FAILURE);
+		#endif
+		close(fds[0]);
+		ln->fd = fds[1];
+		runLane(partNum0, ln, laneFileName);
+		};
+	close(fds[1]);
+	ln->fd = fds[0];
+	};
+	
+printf("[Searching for max_perm from %d down to %d at once]\n",max_perm,max_perm-nLanes+1);
+	
+nLeft = nLanes;
+while (winner<0 && nLeft>0)
+	{
+	//	Wait for any of the searches still running to report back
+	
+	struct pollfd pfd[MAX_LANES];
+	int idx[MAX_LANES], np=0;
+	for (int i=0;i<nLanes;i++) if (!lanes[i].done)
+		{
+		pfd[np].fd = lanes[i].fd;
+		pfd[np].events = POLLIN;
+		idx[np++] = i;
+		};
+	if (poll(pfd, np, -1)<0) continue;
+	
+	for (int k=0;k<np && winner<0;k++)
+	if (pfd[k].revents)
+		{
+		struct lane *ln = lanes+idx[k];
+		FILE *fp = fdopen(ln->fd,"rb");
+		int ok = fp!=NULL && fread(&res, sizeof(struct laneResult), 1, fp)==1;
+		
+		//	Take any lower bounds the search found for higher values of w
+		
+		for (int j=0;j<res.nKLB && ok;j++)
+			{
+			int hdr[3];
+			ok = fread(hdr, sizeof(int), 3, fp)==3 && hdr[0]>tot_bl && hdr[0]<maxW && hdr[2]>0 && hdr[2]<=2*fn;
+			if (!ok) break;
+			if (klbStrings[hdr[0]]==NULL) CHECK_MEM( klbStrings[hdr[0]] = (uint8_t *)malloc(PACKED_SIZE(2*fn)*sizeof(uint8_t)) )
+			uint8_t *p = hdr[1] > mperm_res[hdr[0]] ? klbStrings[hdr[0]] : (uint8_t *)outputLine;
+			ok = fread(p, sizeof(uint8_t), PACKED_SIZE(hdr[2]), fp)==PACKED_SIZE(hdr[2]);
+			if (ok && p==klbStrings[hdr[0]])
+				{
+				mperm_res[hdr[0]] = hdr[1];
+				klbLen[hdr[0]] = hdr[2];
+				};
+			};
+		#if SEARCH_STATS
+			for (int p=0;p<2*fn+2 && ok;p++)
+				{
+				long int row[N_STATS];
+				ok = fread(row, sizeof(long int), N_STATS, fp)==N_STATS;
+				for (int k=0;k<N_STATS && ok;k++) statsTotal[p][k] += row[k];
+				};
+		#endif
+		if (fp!=NULL) fclose(fp); else close(ln->fd);
+		waitpid(ln->pid, NULL, 0);
+		ln->done = TRUE;
+		nLeft--;
+		
+		if (!ok)
+			{
+			printf("The search with max_perm of %d did not report back\n",ln->target);
+			exit(EXIT_FAILURE);
+			};
+			
+		nodeCount += res.nodes;
+		prunedOCP += res.pruned;
+		prunedParity += res.prunedParity;
+		ttCuts += res.ttCuts;
+		
+		if (res.nBest>0)
+			{
+			winner = idx[k];
+			}
+		else
+			{
+			int ro = allExamples ? ln->target : ln->target+1;
+			if (ro < mperm_ruledOut[tot_bl]) mperm_ruledOut[tot_bl] = ro;
+			printf("[Search with max_perm of %d failed, mperm_ruledOut=%d (%lu calls)]\n",ln->target,mperm_ruledOut[tot_bl],nodeCount);
+			
+			sprintf(laneFileName,"%s.%d",finalFileName,ln->target);
+			remove(laneFileName);
+			
+			for (int i=0;i<nLanes;i++) if (!lanes[i].done && lanes[i].target > ln->target)
+				{
+				sprintf(laneFileName,"%s.%d",finalFileName,lanes[i].target);
+				endLane(lanes+i, laneFileName);
+				nLeft--;
+				};
+			};
+		};
+	};
+	
+//	Cancel any searches that are still running
+
+for (int i=0;i<nLanes;i++) if (!lanes[i].done)
+	{
+	sprintf(laneFileName,"%s.%d",finalFileName,lanes[i].target);
+	endLane(lanes+i, laneFileName);
+	};
+	
+if (winner<0)
+	{
+	printf("Backtracking, reducing max_perm from %d to %d, mperm_ruledOut=%d (%lu calls)\n",
+		max_perm,max_perm-nLanes,mperm_ruledOut[tot_bl],nodeCount);
+	max_perm -= nLanes;
+	return FALSE;
+	};
+	
+//	Adopt the results of the search that succeeded
+
+max_perm = res.maxPerm;
+nBest[tot_bl] = res.nBest;
+bestLen[tot_bl] = res.bestLen;
+printf("[Search with max_perm of %d succeeded]\n",lanes[winner].target);
+
+sprintf(laneFileName,"%s.%d",finalFileName,lanes[winner].target);
+if (rename(laneFileName, finalFileName)!=0)
+	{
+	printf("Unable to rename file %s to %s\n",laneFileName,finalFileName);
+	exit(EXIT_FAILURE);
+	};
+	
+#if KEEP_STRINGS
+	FILE *fp = fopen(finalFileName,"rt");
+	if (fp==NULL)
+		{
+		printf("Unable to open file %s to read\n",finalFileName);
+		exit(EXIT_FAILURE);
+		};
+	readBackFile(fp, tot_bl);
+	fclose(fp);
+	free(foundStrings);
+	foundStrings = bestStrings[tot_bl];
+	bestStrings[tot_bl] = NULL;
+	nFoundBytes = nBest[tot_bl]*PACKED_SIZE(bestLen[tot_bl]);
+	maxFoundBytes = nFoundBytes+PACKED_PADDING;
+#endif
+
+return TRUE;
+}
+
+//	Run the search for one lane in a child process, then report the results through the pipe and exit
+
+void runLane(int partNum0, struct lane *ln, const char *laneFileName)
+{
+unsigned long int nodes0 = nodeCount;
+long int pruned0 = prunedOCP, prunedParity0 = prunedParity, ttCuts0 = ttCuts;
+
+strcpy(outputFileName, laneFileName);
+checkpointMinutes = 0;
+max_perm = ln->target;
+bestLen[tot_bl] = max_perm+tot_bl+n-1;
+nBest[tot_bl] = 0;
+#if SEARCH_STATS
+	memset(statsTotal, 0, (2*fn+2)*sizeof(*statsTotal));
+#endif
+
+searchAll(partNum0);
+closeOutputFile();
+
+struct laneResult res = {max_perm, nBest[tot_bl], bestLen[tot_bl], 0, nodeCount-nodes0, prunedOCP-pruned0, prunedParity-prunedParity0,
+	ttCuts-ttCuts0};
+for (int w=tot_bl+1;w<maxW;w++) if (klbLen[w]>0) res.nKLB++;
+
+FILE *fp = fdopen(ln->fd,"wb");
+int ok = fp!=NULL && fwrite(&res, sizeof(struct laneResult), 1, fp)==1;
+for (int w=tot_bl+1;w<maxW && ok;w++) if (klbLen[w]>0)
+	{
+	int hdr[3] = {w, mperm_res[w], klbLen[w]};
+	ok = fwrite(hdr, sizeof(int), 3, fp)==3
+		&& fwrite(klbStrings[w], sizeof(uint8_t), PACKED_SIZE(klbLen[w]), fp)==PACKED_SIZE(klbLen[w]);
+	};
+#if SEARCH_STATS
+	ok = ok && fwrite(statsTotal, sizeof(*statsTotal), 2*fn+2, fp)==2*fn+2;
+#endif
+if (fp!=NULL) fclose(fp);
+fflush(stdout);
+_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+//	Cancel a lane's search, and remove any output it wrote
+
+void endLane(struct lane *ln, const char *laneFileName)
+{
+kill(ln->pid, SIGKILL);
+waitpid(ln->pid, NULL, 0);
+close(ln->fd);
+ln->done = TRUE;
+remove(laneFileName);
+}
+
+//	Step a 64-bit pseudo-random sequence, returning the next value
+
+uint64_t splitMix64(uint64_t *x)
+{
+uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+z = (z ^ (z>>30)) * 0xBF58476D1CE4E5B9ULL;
+z = (z ^ (z>>27)) * 0x94D049BB133111EBULL;
+return z ^ (z>>31);
+}
+
+// this function computes the factorial of a number
+
+int fac(int k)
+{
+if (k <= 1) return 1;
+else return k*fac(k-1);
+}
+
+//	Generate all permutations of 1 ... n;
+//	generates lists for lower values of n
+//	in the process.
+
+void makePerms(int n, int **permTab)
+{
+int fn=fac(n);
+int size=n*fn;
+int *res;
+
+CHECK_MEM( res=(int *)malloc(size*sizeof(int)) )
+
+if (n==1)
+	{
+	res[0]=1;
+	}
+else
+	{
+	makePerms(n-1, permTab-1);
+	int *prev=*(permTab-1);
+	int p=0;
+	int pf=fac(n-1);
+	for (int k=0;k<pf;k++)
+		{
+		for (int q=n-1;q>=0;q--)
+			{
+			int r=0;
+			for (int s=0;s<n;s++)
+				{
+				if (s==q) res[p++]=n;
+				else res[p++]=prev[k*(n-1)+(r++)];
+				};
+			};
+		};
+	};
+
+*permTab = res;
+}
+
+//	The position of a permutation of 1 ... n in lexicographic order
+
+int lexIndex(const char *digits)
+{
+int x=0;
+for (int j=0;j<n;j++)
+	{
+	int c=0;
+	for (int k=j+1;k<n;k++) if (digits[k]<digits[j]) c++;
+	x = x*(n-j)+c;
+	};
+return x;
+}
+
+//	The index of a sequence of n-1 digits with no digit straight after itself, from the first digit and the steps between
+//	successive digits
+
+int partIndex(const char *digits)
+{
+int x = digits[0]-1;
+for (int j=1;j<nm;j++) x = x*nm + (digits[j]-digits[j-1]-1+n)%n;
+return x;
+}
+
+//	The rank of the permutation in the n digits of str ending at e, or -1 if they are not a permutation
+
+int windowRank(const char *str, int e)
+{
+return permWindowN(str,e,n) ? lexRank[lexIndex(str+e-(n-1))] : -1;
+}
+
+//	Write the current string to the output file, starting a new file if newFile is TRUE; the caller must hold resultLock.
+//
+//	Rather than opening and closing the file for every string, we keep it open with a large buffer until the search for the
+//	current w is finished, and flush it whenever we take a checkpoint.
+//
+//	If the "noMirrors" option is in use, a string that is not in canonical orientation is left out (though we still start a
+//	new file if asked to).  Returns the number of strings written, 0 or 1.
+
+int writeCurrentString(struct searchState *ss, int newFile, int size)
+{
+char *curstr = ss->curstr;
+ss->ttEvents++;
+int keep = !(noMirrors && allExamples) || mirrorCompare(curstr, size) >= 0;
+
+if (newFile || outputFile==NULL)
+	{
+	if (outputFile!=NULL) fclose(outputFile);
+	outputFile = fopen(outputFileName,newFile?"wt":"at");
+	if (outputFile==NULL)
+		{
+		printf("Unable to open file %s to %s\n",outputFileName,newFile?"write":"append");
+		exit(EXIT_FAILURE);
+		};
+	setvbuf(outputFile, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+	};
+#if KEEP_STRINGS
+	if (newFile) nFoundBytes = 0;
+#endif
+if (!keep) return 0;
+
+for (int k=0;k<size;k++) outputLine[k] = '0'+curstr[k];
+outputLine[size] = '\n';
+fwrite(outputLine, sizeof(char), size+1, outputFile);
+
+#if KEEP_STRINGS
+	if (nFoundBytes + PACKED_SIZE(size) + PACKED_PADDING > maxFoundBytes)
+		{
+		maxFoundBytes = 2*maxFoundBytes + 64*PACKED_SIZE(size) + PACKED_PADDING;
+		CHECK_MEM( foundStrings = (uint8_t *)realloc(foundStrings, maxFoundBytes*sizeof(uint8_t)) )
+		};
+	packDigits(foundStrings+nFoundBytes, curstr, size);
+	nFoundBytes += PACKED_SIZE(size);
+	memset(foundStrings+nFoundBytes, 0, PACKED_PADDING);
+#endif
+return 1;
+}
+
+//	The mirror image of a string is the reversed string, with the digits relabelled so that it starts with 123...n.  It visits
+//	the same permutations (relabelled) with the same wasted characters, so it belongs on the same list of best strings.
+//
+//	To choose one string from each pair in a way we can check as the string grows, we look at which of its n-digit windows
+//	are permutations, and compare each window in the second half with the window that is as far from the start as it is from
+//	the end, working outwards from the middle of the string.  The first pair that differ decides: the string is in canonical
+//	orientation (and we return 1) if the window in the second half is a permutation, and not (-1) if it is not.  If all the
+//	pairs match we return 0, as the string and its mirror image can't be told apart this way.
+
+int mirrorCompare(const char *str, int len)
+{
+for (int e=(len+n)/2; e<len; e++)
+	{
+	int p1 = permWindowN(str, e, n), p0 = permWindowN(str, len+n-2-e, n);
+	if (p1 != p0) return p1 ? 1 : -1;
+	};
+return 0;
+}
+
+void mirrorImage(char *mirror, const char *str, int len)
+{
+char relabel[MAX_N+1];
+for (int k=0;k<n;k++) relabel[(int)str[len-1-k]] = k+1;
+for (int k=0;k<len;k++) mirror[k] = relabel[(int)str[len-1-k]];
+}
+
+//	Bring the list of best strings for w to the full set, whether it holds every string or only those in canonical orientation.
+//
+//	We keep the strings in canonical orientation, and add the mirror image of each one where the mirror image is not itself in
+//	canonical orientation; a string that compares equal to its mirror image will have found that on the list as well.
+
+void addMirrorImages(int w)
+{
+int len = bestLen[w];
+long int size = PACKED_SIZE(len);
+char *str, *mirror;
+uint8_t *list;
+CHECK_MEM( str = (char *)malloc(len*sizeof(char)) )
+CHECK_MEM( mirror = (char *)malloc(len*sizeof(char)) )
+CHECK_MEM( list = (uint8_t *)calloc(2*nBest[w]*size+PACKED_PADDING, sizeof(uint8_t)) )
+
+int count = 0;
+for (int i=0;i<nBest[w];i++)
+	{
+	unpackDigits(str, bestStrings[w]+i*size, len);
+	int c = mirrorCompare(str, len);
+	if (c < 0) continue;
+	packDigits(list+(count++)*size, str, len);
+	if (c > 0)
+		{
+		mirrorImage(mirror, str, len);
+		packDigits(list+(count++)*size, mirror, len);
+		};
+	};
+	
+freeBestStrings(w);
+bestStrings[w] = list;
+nBest[w] = count;
+free(str);
+free(mirror);
+}
+
+//	Close the output file, once the search for the current w is finished
+
+void closeOutputFile(void)
+{
+if (outputFile!=NULL)
+	{
+	if (fclose(outputFile)!=0)
+		{
+		printf("Unable to write file %s\n",outputFileName);
+		exit(EXIT_FAILURE);
+		};
+	outputFile = NULL;
+	};
+}
+
+//	Allocate and initialise the search state for one thread
+
+void initState(struct searchState *ss, int id, int rank0)
+{
+ss->id = id;
+
+//	Storage for current string
+
+CHECK_MEM( ss->curstr = (char *)malloc(2*fn*sizeof(char)) )
+for (int j0=0;j0<n;j0++) ss->curstr[j0] = j0+1;
+
+//	Values of discriminant (sign says whether to go deeper)
+
+CHECK_MEM( ss->dvals = (int *)calloc(2*fn, sizeof(int)) )
+
+//	Stack of frames for the search
+
+CHECK_MEM( ss->frames = (struct frame *)malloc((2*fn+2)*sizeof(struct frame)) )
+CHECK_MEM( ss->trieFrames = (struct trieFrame *)malloc((2*fn+2)*sizeof(struct trieFrame)) )
+
+//	Flags that say whether we have visited a given permutation
+
+CHECK_MEM( ss->visited = (uint64_t *)malloc(nWords*sizeof(uint64_t)) )
+clearFlags(ss, rank0);
+
+//	1-cycle information
+
+CHECK_MEM( ss->oneCycleCounts = (int *)malloc(noc*sizeof(int)) )
+for (int i=0;i<noc;i++) ss->oneCycleCounts[i]=n;
+ss->oneCycleCounts[oneCycleIndices[rank0]]=n-1;
+
+CHECK_MEM( ss->oneCycleSorted = (int *)malloc(noc*sizeof(int)) )
+for (int i=0;i<noc;i++) ss->oneCycleSorted[i]=n;
+ss->oneCycleSorted[noc-1]=n-1;
+
+for (int b=0;b<=n+1;b++)
+	{
+	ss->oneCycleCum[b] = b<n ? noc : b==n ? noc-1 : 0;
+	ss->oneCycleSum[b] = b<n ? noc*n-1 : b==n ? (noc-1)*n : 0;
+	};
+	
+if (parityTier)
+for (int q=0;q<2;q++)
+	{
+	int q0 = q==cycleParity[oneCycleIndices[rank0]];
+	CHECK_MEM( ss->paritySorted[q] = (int *)malloc(nParity[q]*sizeof(int)) )
+	for (int i=0;i<nParity[q];i++) ss->paritySorted[q][i]=n;
+	if (q0) ss->paritySorted[q][nParity[q]-1]=n-1;
+	
+	for (int b=0;b<=n+1;b++)
+		{
+		ss->parityCum[q][b] = b<n ? nParity[q] : b==n ? nParity[q]-q0 : 0;
+		ss->paritySum[q][b] = b<n ? nParity[q]*n-q0 : b==n ? (nParity[q]-q0)*n : 0;
+		};
+	};
+
+CHECK_MEM( ss->visitLog = (int *)malloc(2*fn*sizeof(int)) )
+ss->visitLog[0] = rank0;
+ss->nVisitLog = 1;
+
+CHECK_MEM( ss->zHash = (uint64_t *)malloc((2*fn+2)*sizeof(uint64_t)) )
+CHECK_MEM( ss->ttMark = (unsigned long int *)malloc((2*fn+2)*sizeof(unsigned long int)) )
+ss->ttEvents = 0;
+
+ss->fallBackTo = 2*fn;
+ss->splitPos = 2*fn+1;
+ss->task = NULL;
+ss->parkedPos = -1;
+ss->split = NULL;
+ss->nSplit = ss->maxSplit = 0;
+
+CHECK_MEM( ss->deque.tasks = (struct task **)malloc(sizeof(struct task *)) )
+ss->deque.head = ss->deque.tail = 0;
+pthread_mutex_init(&ss->deque.lock, NULL);
+
+ss->nodeCount = 0;
+ss->prunedOCP = 0;
+ss->prunedParity = 0;
+ss->ttCuts = 0;
+#if SEARCH_STATS
+	CHECK_MEM( ss->stats = (long int (*)[N_STATS])calloc(2*fn+2, sizeof(*ss->stats)) )
+#endif
+}
+
+//	Flag all permutations as unvisited, apart from the first; this is only needed when setting up a new state.
+//
+//	We also set the bit for the non-existent permutation of rank fn, which stands in for the permutation after
+//	0 or 1 wasted characters when there is none; treating that as visited makes the choice to waste more characters
+//	look no better than any other.
+
+void clearFlags(struct searchState *ss, int rank0)
+{
+for (int i=0; i<nWords; i++) ss->visited[i] = 0;
+SET_VISITED(ss->visited,rank0);
+SET_VISITED(ss->visited,fn);
+}
+
+//	Unvisit permutations, most recent first, until only the first mark entries in the visit log remain.
+//
+//	Every search unvisits the permutations it visits as it backs out of the tree, so when a search has run to completion this
+//	costs nothing, and it never costs more than the number of permutations that a search left behind when it was cut short;
+//	there is no need to sweep through flags for all permutations between searches.
+
+void unvisitTo(struct searchState *ss, int mark)
+{
+while (ss->nVisitLog > mark)
+	{
+	int rank = ss->visitLog[--ss->nVisitLog];
+	CLEAR_VISITED(ss->visited,rank);
+	if (ocpTrackingOn)
+		{
+		UNVISIT_CYCLE(ss,rank)
+		};
+	};
+}
+
+//	Read a table of the maximum permutation counts for each w, with one line per w giving w and the count, as written to
+//	ChaffinMethodMaxPerms_<n>.txt
+
+void readKnownTable(const char *fileName)
+{
+FILE *fp = fopen(fileName,"rt");
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to read\n",fileName);
+	exit(EXIT_FAILURE);
+	};
+	
+char line[256];
+int nRead = 0;
+while (fgets(line, sizeof(line), fp)!=NULL)
+	{
+	int w, p;
+	if (sscanf(line,"%d %d",&w,&p)!=2) continue;
+	if (w<0 || w>=maxW || p<n || p>fn)
+		{
+		printf("The file %s has an invalid line: %s",fileName,line);
+		exit(EXIT_FAILURE);
+		};
+	knownMax[w] = p;
+	nRead++;
+	};
+fclose(fp);
+printf("Read %d maximum permutation counts from %s\n",nRead,fileName);
+}
+
+//	Read back a list of strings from a text file, packing the digits
+
+void readBackFile(FILE *fp, int w)
 {
-CHECK_MEM( bestStrings[w] = (char *)malloc(bestLen[w]*nBest[w]*sizeof(char)) )
+long int size = PACKED_SIZE(bestLen[w]);
+CHECK_MEM( bestStrings[w] = (uint8_t *)calloc(nBest[w]*size+PACKED_PADDING, sizeof(uint8_t)) )
+bestMapped[w] = 0;
 
-int ptr=0;
+char *line;
+CHECK_MEM( line = (char *)malloc(bestLen[w]*sizeof(char)) )
 for (int i=0;i<nBest[w];i++)
 	{
 	for (int j=0;j<bestLen[w];j++)
 		{
-		bestStrings[w][ptr++] = fgetc(fp)-'0';
+		line[j] = fgetc(fp)-'0';
 		};
 	fgetc(fp);
+	packDigits(bestStrings[w]+i*size, line, bestLen[w]);
 	};
+free(line);
 }
 
-//	Compare two digitScore structures for quicksort()
+//	Map a packed file of strings into memory, as the list of best strings for w; returns FALSE if the file can't be used.
+//
+//	The file starts with a header giving n, w, the number of strings and their length, followed by the packed digits
+//	and padding; the list is used in place, so it only takes up memory as the search touches it.
 
-int compareDS(const void *ii0, const void *jj0)
+int mapBestStrings(const char *fileName, int w)
 {
-struct digitScore *ii=(struct digitScore *)ii0, *jj=(struct digitScore *)jj0;
-if (ii->score < jj->score) return -1;
-if (ii->score > jj->score) return 1;
-if (ii->digit < jj->digit) return -1;
-if (ii->digit > jj->digit) return 1;
-return 0;
+int fd = open(fileName, O_RDONLY);
+if (fd<0) return FALSE;
+
+struct stat st;
+char magic[sizeof(BEST_STRINGS_MAGIC)];
+int header[5];
+int hsize = strlen(BEST_STRINGS_MAGIC) + sizeof(header);
+int ok = fstat(fd, &st)==0 && st.st_size >= hsize
+	&& read(fd, magic, strlen(BEST_STRINGS_MAGIC))==strlen(BEST_STRINGS_MAGIC)
+	&& strncmp(magic, BEST_STRINGS_MAGIC, strlen(BEST_STRINGS_MAGIC))==0
+	&& read(fd, header, sizeof(header))==sizeof(header)
+	&& header[0]==BEST_STRINGS_VERSION && header[1]==n && header[2]==w && header[3]>0 && header[4]>0
+	&& st.st_size == hsize + header[3]*PACKED_SIZE(header[4]) + PACKED_PADDING;
+if (!ok)
+	{
+	printf("Ignoring file %s, which is not a valid packed list of strings for n=%d, w=%d\n",fileName,n,w);
+	close(fd);
+	return FALSE;
+	};
+	
+void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+close(fd);
+if (map==MAP_FAILED) return FALSE;
+
+nBest[w] = header[3];
+bestLen[w] = header[4];
+bestStrings[w] = (uint8_t *)map + hsize;
+bestMapped[w] = st.st_size;
+return TRUE;
+}
+
+//	Write the list of best strings for w to a packed file
+
+void writeBestStrings(const char *fileName, int w)
+{
+int header[] = {BEST_STRINGS_VERSION, n, w, nBest[w], bestLen[w]};
+FILE *fp = fopen(fileName,"wb");
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to write\n",fileName);
+	return;
+	};
+fwrite(BEST_STRINGS_MAGIC, sizeof(char), strlen(BEST_STRINGS_MAGIC), fp);
+fwrite(header, sizeof(int), 5, fp);
+static uint8_t padding[PACKED_PADDING];
+fwrite(bestStrings[w], sizeof(uint8_t), nBest[w]*PACKED_SIZE(bestLen[w]), fp);
+fwrite(padding, sizeof(uint8_t), PACKED_PADDING, fp);
+if (fclose(fp)!=0) printf("Unable to write file %s\n",fileName);
+}
+
+//	Rewrite the text file for w from the list of best strings, once "noMirrors" has restored the mirror images
+
+void writeTextStrings(const char *fileName, int w)
+{
+int len = bestLen[w];
+long int size = PACKED_SIZE(len);
+FILE *fp = fopen(fileName,"wt");
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to write\n",fileName);
+	exit(EXIT_FAILURE);
+	};
+setvbuf(fp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+for (int i=0;i<nBest[w];i++)
+	{
+	unpackDigits(outputLine, bestStrings[w]+i*size, len);
+	for (int k=0;k<len;k++) outputLine[k] += '0';
+	outputLine[len] = '\n';
+	fwrite(outputLine, sizeof(char), len+1, fp);
+	};
+if (fclose(fp)!=0)
+	{
+	printf("Unable to write file %s\n",fileName);
+	exit(EXIT_FAILURE);
+	};
+}
+
+//	Map the tables of next digits from a file written by writeTables(); the file holds a header padded to the size of a
+//	row, so that the rows of nextDigits stay aligned to cache lines, then nextDigits, then digitSlot
+
+int mapTables(const char *fileName)
+{
+int fd = open(fileName, O_RDONLY);
+if (fd<0) return FALSE;
+
+struct stat st;
+char magic[sizeof(TABLES_MAGIC)];
+int header[5];
+long int dsSize = (long int)nParts*DS_ALIGN, slotSize = (long int)nParts*DS_ROW;
+int ok = fstat(fd, &st)==0
+	&& read(fd, magic, strlen(TABLES_MAGIC))==strlen(TABLES_MAGIC)
+	&& strncmp(magic, TABLES_MAGIC, strlen(TABLES_MAGIC))==0
+	&& read(fd, header, sizeof(header))==sizeof(header)
+	&& header[0]==TABLES_VERSION && header[1]==n && header[2]==nParts && header[3]==DS_ROW && header[4]==(int)sizeof(struct digitScore)
+	&& st.st_size == DS_ALIGN + dsSize + slotSize;
+if (!ok)
+	{
+	printf("Ignoring file %s, which is not a valid table of next digits for n=%d\n",fileName,n);
+	close(fd);
+	return FALSE;
+	};
+	
+void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+close(fd);
+if (map==MAP_FAILED) return FALSE;
+
+nextDigits = (struct digitScore *)((char *)map + DS_ALIGN);
+digitSlot = (uint8_t *)map + DS_ALIGN + dsSize;
+return TRUE;
+}
+
+//	Write the tables of next digits to a file, for later runs to map.  We write to a temporary file and then rename it,
+//	so that another run starting at the same time will never see a partly written file.
+
+void writeTables(const char *fileName)
+{
+char tmpFileName[300];
+sprintf(tmpFileName,"%s.%d",fileName,(int)getpid());
+int header[] = {TABLES_VERSION, n, nParts, DS_ROW, (int)sizeof(struct digitScore)};
+static char padding[DS_ALIGN];
+FILE *fp = fopen(tmpFileName,"wb");
+if (fp==NULL)
+	{
+	printf("Unable to open file %s to write\n",tmpFileName);
+	return;
+	};
+fwrite(TABLES_MAGIC, sizeof(char), strlen(TABLES_MAGIC), fp);
+fwrite(header, sizeof(int), 5, fp);
+fwrite(padding, sizeof(char), DS_ALIGN-strlen(TABLES_MAGIC)-sizeof(header), fp);
+fwrite(nextDigits, sizeof(struct digitScore), (long int)nParts*DS_ROW, fp);
+fwrite(digitSlot, sizeof(uint8_t), (long int)nParts*DS_ROW, fp);
+if (fclose(fp)!=0 || rename(tmpFileName, fileName)!=0)
+	{
+	printf("Unable to write file %s\n",fileName);
+	remove(tmpFileName);
+	};
+}
+
+//	Release the list of best strings for w, whether it was allocated or mapped
+
+void freeBestStrings(int w)
+{
+if (bestMapped[w])
+	{
+	munmap(bestStrings[w] - (strlen(BEST_STRINGS_MAGIC) + 5*sizeof(int)), bestMapped[w]);
+	}
+else free(bestStrings[w]);
+bestStrings[w] = NULL;
+bestMapped[w] = 0;
 }
 
-//	Cycle a string of integers so the lowest comes first
+//	Pack a string of len digits into the bytes starting at p
 
-void rClassMin(int *p, int n)
+void packDigits(uint8_t *p, const char *digits, int len)
 {
-int min=p[0], km=0;
-for (int k=1;k<n;k++) if (p[k]<min) {min=p[k]; km=k;};
+unsigned int bits=0;
+int nbits=0;
+for (int k=0;k<len;k++)
+	{
+	bits |= PACK_DIGIT(digits[k])<<nbits;
+	nbits += DBITS;
+	if (nbits >= 8)
+		{
+		*p++ = bits & 255;
+		bits >>= 8;
+		nbits -= 8;
+		};
+	};
+if (nbits > 0) *p = bits;
+}
+
+//	Unpack a string of len digits from the bytes starting at p
 
-for (int r=0;r<km;r++)
+void unpackDigits(char *digits, const uint8_t *p, int len)
+{
+unsigned int bits=0;
+int nbits=0;
+for (int k=0;k<len;k++)
 	{
-	int tmp=p[0];
-	for (int i=1;i<n;i++)
+	if (nbits < DBITS)
 		{
-		p[i-1]=p[i];
+		bits |= (*p++)<<nbits;
+		nbits += 8;
 		};
-	p[n-1]=tmp;
+	digits[k] = UNPACK_DIGIT(bits & ((1<<DBITS)-1));
+	bits >>= DBITS;
+	nbits -= DBITS;
 	};
 }
 
+//	Compare two digitScore structures for quicksort()
+
+int compareDS(const void *ii0, const void *jj0)
+{
+struct digitScore *ii=(struct digitScore *)ii0, *jj=(struct digitScore *)jj0;
+if (ii->score < jj->score) return -1;
+if (ii->score > jj->score) return 1;
+if (ii->digit < jj->digit) return -1;
+if (ii->digit > jj->digit) return 1;
+return 0;
+}
+
 //	With w characters available to waste, can we visit enough new permutations to match or increase max_perm?
 //
 //	We have one upper bound on the new permutations in mperm_res[w], and another we can calculate from the numbers of 1-cycles with various
@@ -1047,78 +3433,141 @@ for (int r=0;r<km;r++)
 
 //	We add the smaller of these bounds to d0, which is count of perms we've already seen, minus max_perm
 //	(or if calculating, we return as soon as the sign of the sum is determined)
+//
+//	The 1-cycle bound comes from taking the w 1-cycles with the most unvisited permutations.  Working down through the counts
+//	from n, we would stop early, with the partial sum, once that sum was positive or reached the first bound; otherwise we stop
+//	at the count b of the w-th 1-cycle.  Rather than looping, we look up b in the sorted list of counts, and we only need to
+//	search for where we would have stopped early if the sum for all the counts above b is large enough.
 
-int pruneOnPerms(int w, int d0)
+KERNEL int pruneOnPermsN(struct searchState *ss, int w, int d0, const int n)
 {
 int res = d0 + mperm_res[w];
+SET_CUT_SOURCE(ss,STAT_CUT_MPERM)
 if (ocpTrackingOff || res < 0) return res;
-int res0 = d0;
+int res0;
 w++;				//	We have already subtracted waste characters needed to reach first permutation, so we get the first 1-cycle for free
 
-//	oneCycleBins[b] contains count of how many 1-cycles have b unvisited permutations, where b is from 0 to n.
+int b = w<=noc ? ss->oneCycleSorted[w-1] : 0;
+int thresh = (res>0 ? 1 : 0) - d0;
+if (b<n && ss->oneCycleSum[b+1] >= thresh)
+	{
+	int k = n;
+	while (ss->oneCycleSum[k] < thresh) k--;
+	res0 = d0 + ss->oneCycleSum[k];
+	}
+else res0 = d0 + ss->oneCycleSum[b+1] + (w - ss->oneCycleCum[b+1])*b;
 
-for (int b=n;b>0;b--)
+if (res0 >= res) res0 = res;
+else
 	{
-	int ocb = oneCycleBins[b];
-	if (w<=ocb)
-		{
-		res0+=w*b;
-		if (res0 >= res) return res;
-		else
-			{
-			MONITOR_OCP
-			return res0;
-			};
-		}
-	else
-		{
-		res0+=ocb*b;
-		w-=ocb;
-		};
-	if (res0 >= res) return res;
-	if (res0 > 0)
+	SET_CUT_SOURCE(ss,STAT_CUT_OCP)
+	MONITOR_OCP
+	};
+	
+//	If that doesn't rule out this branch, try the bound from the parities of the 1-cycles
+
+if (parityTier && res0 >= 0)
+	{
+	int res2 = d0 + parityBound(ss, w-1);
+	if (res2 < res0 && res2 <= 0)
 		{
-		MONITOR_OCP
-		return res0;
+		ss->prunedParity++;
+		SET_CUT_SOURCE(ss,STAT_CUT_PARITY)
+		return res2;
 		};
 	};
-MONITOR_OCP
 return res0;
 }
 
-void printDigits(int t)
+//	Test whether the n-digit window of a string that ends at position e is a permutation
+
+KERNEL int permWindowN(const char *str, int e, const int n)
+{
+int mask = 0;
+for (int k=0;k<n;k++) mask |= 1<<str[e-k];
+return mask == (1<<(n+1))-2;
+}
+
+//	The key for the state at the node at level pos in the transposition table: the Zobrist hash of the set of permutations
+//	visited, combined with a hash of the last n-1 digits and the flag saying whether the last digit completed a permutation
+
+KERNEL uint64_t ttKey(struct searchState *ss, int pos, struct frame *f)
 {
-printf("t=%d\n",t);
-for (int k=0;k<n;k++)
-	{
-	printf("%c",'0'+(t&7));
-	t=t>>DBITS;
-	};
-printf("\n");
+uint64_t z = 2*(uint64_t)f->partNum + (f->leftPerm ? 1 : 0);
+return ss->zHash[pos] ^ splitMix64(&z);
+}
+
+//	The index in the history table for the node at level pos whose last n-1 digits have index partNum
+
+KERNEL uint32_t historyIndex(int pos, int partNum)
+{
+return (uint32_t)((((uint64_t)pos*nParts + partNum) * 0x9E3779B97F4A7C15ULL) >> (64-HISTORY_BITS));
+}
+
+//	Record the digit chosen at each level of a string that increased max_perm, which ends at position pos
+
+void recordHistory(const char *str, int pos)
+{
+for (int j=n;j<=pos;j++) historyDigit[historyIndex(j,partIndex(str+j-(n-1)))] = str[j];
+}
+
+//	For odd n, every change of 1-cycle costs at least one wasted character, and a change that costs just one wasted
+//	character takes us to a 1-cycle of the opposite parity.  So with w wasted characters to spend after reaching a first
+//	1-cycle, if we visit a further 1-cycles of the opposite parity to the first and b of the same parity, we need at least
+//	a+b+max(0,a-b-1,b-a) wasted characters.
+//
+//	As the 1-cycles of each parity are taken in decreasing order of their counts of unvisited permutations, the best
+//	choices are a=b=w/2 for even w, with either parity for the first 1-cycle, or a=b=(w-1)/2 and one more 1-cycle of
+//	the opposite parity for odd w.
+
+int parityBound(struct searchState *ss, int w)
+{
+int h = w/2;
+int t0 = sumTopCycles(ss->parityCum[0], ss->paritySum[0], ss->paritySorted[0], nParity[0], h+1);
+int t1 = sumTopCycles(ss->parityCum[1], ss->paritySum[1], ss->paritySorted[1], nParity[1], h+1);
+if (w%2==1) return t0+t1;
+int s0 = sumTopCycles(ss->parityCum[0], ss->paritySum[0], ss->paritySorted[0], nParity[0], h);
+int s1 = sumTopCycles(ss->parityCum[1], ss->paritySum[1], ss->paritySorted[1], nParity[1], h);
+return t0+s1 > s0+t1 ? t0+s1 : s0+t1;
+}
+
+//	The total number of unvisited permutations in the k 1-cycles with the most, given the sorted counts and the cumulative
+//	information for a set of size 1-cycles
+
+int sumTopCycles(int *cum, int *sum, int *sorted, int size, int k)
+{
+if (k<=0) return 0;
+if (k>size) k=size;
+int b = sorted[k-1];
+return sum[b+1] + (k-cum[b+1])*b;
 }
 
-//	Given the state of the unvisited[] flags (plus we have arrived at tperm, not yet flagged)
+//	Given the state of the visited[] flags (plus we have arrived at the permutation with the given rank, not yet flagged)
 //	how many permutations can we get by following a single weight-2 edge, and then as many weight-1 edges
 //	as possible before we hit a permutation already visited.
+//
+//	The caller must hold resultLock.
 
-void maybeUpdateLowerBound(int tperm, int size, int w, int p)
+void maybeUpdateLowerBound(struct searchState *ss, int rank, int size, int w, int p)
 {
+char *curstr = ss->curstr;
+uint64_t *visited = ss->visited;
 int unv[MAX_N+1];
 
-unvisited[tperm]=FALSE;
+SET_VISITED(visited,rank);
 
 //	Follow weight-2 edge
 
-int t=successor2[tperm];
+int t=successor2[rank];
 
 //	Follow successive weight-1 edges
 
 int nu=0, okT=0;
-while (unvisited[t])
+while (!VISITED(visited,t))
 	{
-	unv[nu++]=t;		//	Record, so we can unroll
-	unvisited[t]=FALSE;	//	Mark as visited
-	okT = t;			//	Record the last unvisited permutation integer
+	unv[nu++]=t;			//	Record, so we can unroll
+	SET_VISITED(visited,t);	//	Mark as visited
+	okT = t;				//	Record the last unvisited permutation rank
 	t=successor1[t];
 	};
 	
@@ -1132,12 +3581,13 @@ if (nu > 0 && m > mperm_res[w+1])
 	curstr[size+1] = curstr[size-n];
 	for (int j=0;j<nu-1;j++) curstr[size+2+j] = curstr[size-(n-2)+j];
 
-	for (int k=0;k<size+nu+1;k++) klbStrings[w+1][k]=curstr[k];
 	klbLen[w+1] = size+nu+1;
+	if (klbStrings[w+1]==NULL) CHECK_MEM( klbStrings[w+1] = (uint8_t *)malloc(PACKED_SIZE(2*fn)*sizeof(uint8_t)) )
+	packDigits(klbStrings[w+1], curstr, klbLen[w+1]);
 	
-	maybeUpdateLowerBound(okT, klbLen[w+1], w+1, m);
+	maybeUpdateLowerBound(ss, okT, klbLen[w+1], w+1, m);
 	};
 
-for (int i=0;i<nu;i++) unvisited[unv[i]]=TRUE;
-unvisited[tperm]=TRUE;
+for (int i=0;i<nu;i++) CLEAR_VISITED(visited,unv[i]);
+CLEAR_VISITED(visited,rank);
 }
@@ -71,6 +71,10 @@ For more details, see the accompanying README.
 
 #include <unistd.h>
 #include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
 
 #define TRUE (1==1)
 #define FALSE (1==0)
@@ -141,6 +145,26 @@ For more details, see the accompanying README.
 
 #define SERVER_RESPONSE_FILE_NAME_TEMPLATE "DCMServerResponse_%u.txt"
 
+//	Set IN_PROCESS_HTTP to TRUE to send commands to the server ourselves, over a connection we keep open from one command
+//	to the next, rather than running URL_UTILITY for each one and reading its output back from a file.  This needs POSIX
+//	sockets, so it is only the default for MacOS and Linux.
+
+#ifndef IN_PROCESS_HTTP
+	#define IN_PROCESS_HTTP UNIX_LIKE
+#endif
+
+//	Time we wait for the server to accept a connection, or to send or receive any data, before giving up on a command
+
+#ifndef HTTP_TIMEOUT
+	#define HTTP_TIMEOUT (MINUTE)
+#endif
+
+//	Each kind of request gets its own connection, as they can go to different hosts
+
+#define SERVER_CHANNEL 0		//	Commands sent to the server
+#define IC_CHANNEL 1			//	Fetching the server's instance count
+#define N_CHANNELS 2
+
 //	Name of log file
 
 #define LOG_FILE_NAME_TEMPLATE "DCMLog_%u.txt"
@@ -223,6 +247,21 @@ int nextPart;
 int nextPerm;
 };
 
+#if IN_PROCESS_HTTP
+
+//	A connection to a web server, and the bytes it has sent that we have not yet dealt with
+
+struct httpConnection
+{
+int fd;						//	Socket, or -1 if there is no connection
+char host[FILE_NAME_SIZE];	//	Host and port it is connected to
+char port[16];
+char in[BUFFER_SIZE];		//	Bytes received
+size_t start, end;			//	The ones we have not dealt with yet are in[start] ... in[end-1]
+};
+
+#endif
+
 struct task
 {
 unsigned int task_id;
@@ -312,6 +351,20 @@ int maxTimeInSubtree = DEFAULT_MAX_TIME_IN_SUBTREE;
 
 int serverPressure = 0;				//	Set greater than 0 if server is facing heavy traffic
 
+const char *serverURL = SERVER_URL;	//	URL that commands are appended to, which can be changed with the "server" option
+
+//	The server's response to the last command, as a null-terminated string
+
+char *serverResponse = NULL;
+size_t serverResponseLen = 0, serverResponseSize = 0;
+
+#if IN_PROCESS_HTTP
+
+struct httpConnection connections[N_CHANNELS] = {{-1},{-1}};	//	Connections kept open between requests
+int connectionBusy[N_CHANNELS];									//	Set TRUE while a request is using a connection
+
+#endif
+
 #if UNIX_LIKE
 
 //	Signal action structure
@@ -348,6 +401,11 @@ int timeQuotaMins=0, timeQuotaHardMins=0, timeQuotaEitherMins=0;
 
 int longRunner=FALSE;
 
+//	When the "bench" option is chosen, we make no contact with the server, and just run each of the fixed tasks in
+//	benchTasks[] to completion without splitting, reporting the nodes searched, the time taken and the best string found
+
+int benchMode=FALSE;
+
 //  Default team name
 #define DEFAULT_TEAM_NAME "anonymous"
 #define MAX_TEAM_NAME_LENGTH 32
@@ -365,6 +423,23 @@ int known6[][2]={{0,6},{1,12},{2,18},{3,24},{4,30},{5,34},{6,40},{7,46},{8,52},{
 int *knownN=NULL;
 int numKnownW=0;
 
+//	Fixed tasks for the "bench" option.  Each one looks for a string with the known maximum number of permutations for
+//	its w, then carries on exhaustively through the tree below its prefix trying to find a string with one more, so the
+//	node count and the best string found will be the same on every run.
+
+struct benchTask
+{
+int n, w;
+char *prefix;
+};
+
+struct benchTask benchTasks[] = {
+	{5, 28, "12345"},
+	{6, 80, "123456"},
+	{6, 90, "123456"},
+	{6, 100, "1234561234516234512634512364512346512436512463512465312465132465134265"}
+	};
+
 
 //	Function definitions
 //	--------------------
@@ -373,6 +448,18 @@ void logString(const char *s);
 void sleepForSecs(int secs);
 void setupForN(int nval);
 int sendServerCommand(const char *command);
+int fetchURL(const char *url, int channel);
+void appendToResponse(const char *s, size_t len);
+char *nextResponseLine(char *buffer, int size, const char **cursor);
+#if IN_PROCESS_HTTP
+int parseURL(const char *url, char *host, size_t hostSize, char *port, size_t portSize, const char **path);
+int httpConnect(struct httpConnection *hc, const char *host, const char *port);
+void httpClose(struct httpConnection *hc);
+ssize_t httpFill(struct httpConnection *hc);
+int httpGetLine(struct httpConnection *hc, char *line, size_t size);
+int httpReadBody(struct httpConnection *hc, size_t len);
+int httpGet(struct httpConnection *hc, const char *path, int *keepAlive);
+#endif
 int sendServerCommandAndLog(const char *s, const char **responseList, int nrl);
 int logServerResponse(const char **responseList, int nrl);
 void registerClient(void);
@@ -399,6 +486,7 @@ void sigIntHandler(int a);
 void sleepUntilSiblingsFreeServer(void);
 void releaseServerLock(void);
 void nodesAndTime(void);
+void runBenchmarks(void);
 
 //	Main program
 //	------------
@@ -463,7 +551,9 @@ logString(buffer);
 for (int i=1;i<argc;i++)
 	{
 	if (strcmp(argv[i],"test")==0) justTest=TRUE;
+	else if (strcmp(argv[i],"bench")==0) benchMode=TRUE;
 	else if (strcmp(argv[i],"longRunner")==0) longRunner=TRUE;
+	else if (strcmp(argv[i],"server")==0 && i+1<argc) serverURL=argv[++i];
 	else if (strcmp(argv[i],"timeLimit")==0)
 		{
 		if (i+1<argc)
@@ -544,6 +634,21 @@ for (int i=1;i<argc;i++)
 		};
 	};
 
+if (benchMode)
+	{
+	runBenchmarks();
+	exit(0);
+	};
+
+#if IN_PROCESS_HTTP
+
+//	If the server has closed the connection we keep open, writing to it should fail with an error we can deal with,
+//	rather than killing the program
+
+signal(SIGPIPE, SIG_IGN);
+
+#endif
+
 //	First, just check we can establish contact with the server
 
 sprintf(buffer,"Team name: %s",teamName);
@@ -701,6 +806,9 @@ return 0;
 //	Function to set up storage and various tables for a given value of n
 //
 //	Storage is deallocated from previous use if necessary
+//
+//	Unlike ChaffinMethod, we don't cache these tables in a file: they are only built when n changes, so once for each
+//	run of the program, and take about 4ms for n=6 (0.1s for n=7), which is nothing next to the time spent on a task.
 
 void setupForN(int nval)
 {
@@ -1068,7 +1176,7 @@ asciiString[bestSeenLen] = '\0';
 
 //	Finish with current task with the server
 
-if (!cancelledTask)
+if (!cancelledTask && !benchMode)
 while (TRUE)
 	{
 	sprintf(buffer,"action=finishTask&id=%u&access=%u&str=%s&pro=%u&team=%s&nodeCount=%"PRId64,
@@ -1106,6 +1214,59 @@ sprintf(buffer,"--------------------------------------------------------\n");
 logString(buffer);
 }
 
+//	Run the fixed tasks in benchTasks[], with no contact with the server
+
+void runBenchmarks()
+{
+static char buffer[BUFFER_SIZE];
+int nbt = sizeof(benchTasks)/sizeof(benchTasks[0]);
+int64_t benchNodes=0;
+double benchSecs=0;
+
+for (int i=0;i<nbt;i++)
+	{
+	struct benchTask *bt = benchTasks+i;
+	size_t plen = strlen(bt->prefix);
+	
+	setupForN(bt->n);
+	if (knownN==NULL || bt->w >= numKnownW)
+		{
+		printf("Error: No data available for n=%d, w=%d\n",bt->n,bt->w);
+		exit(EXIT_FAILURE);
+		};
+	
+	currentTask.task_id = i+1;
+	currentTask.access_code = 0;
+	currentTask.n_value = bt->n;
+	currentTask.w_value = bt->w;
+	CHECK_MEM( currentTask.prefix = malloc((plen+1)*sizeof(char)) )
+	strcpy(currentTask.prefix, bt->prefix);
+	CHECK_MEM( currentTask.branchOrder = malloc((plen+1)*sizeof(char)) )
+	for (int k=0;k<plen;k++) currentTask.branchOrder[k]='0';
+	currentTask.branchOrder[plen]='\0';
+	currentTask.prefixLen = currentTask.branchOrderLen = (unsigned int)plen;
+	currentTask.perm_to_exceed = knownN[2*bt->w+1]-1;
+	currentTask.prev_perm_ruled_out = knownN[2*bt->w+1]+2;
+	currentTask.timeBeforeSplit = currentTask.maxTimeInSubtree = currentTask.timeBetweenServerCheckins = 0;
+	
+	clock_t c0 = clock();
+	doTask();
+	double secs = (double)(clock()-c0)/CLOCKS_PER_SEC;
+	
+	//	On return from doTask(), asciiString holds the best string seen
+	
+	sprintf(buffer,"Benchmark task %d: n=%d, w=%d, prefix=%s, nodes=%"PRId64", seconds=%.3f, nodes per second=%.0f, bestSeenP=%d, best=%s",
+		i+1, bt->n, bt->w, bt->prefix, totalNodeCount, secs, secs>0 ? totalNodeCount/secs : 0.0, bestSeenP, asciiString);
+	logString(buffer);
+	benchNodes += totalNodeCount;
+	benchSecs += secs;
+	};
+
+sprintf(buffer,"Benchmark total: nodes=%"PRId64", seconds=%.3f, nodes per second=%.0f",
+	benchNodes, benchSecs, benchSecs>0 ? benchNodes/benchSecs : 0.0);
+logString(buffer);
+}
+
 void nodesAndTime()
 {
 static char buffer[BUFFER_SIZE];
@@ -1173,7 +1334,7 @@ if (++nodesChecked >= nodesBeforeTimeCheck)
 	timeOfLastTimeCheck = timeNow;
 	nodesChecked = 0;
 	
-	if (timeSinceLastServerCheckin > timeBetweenServerCheckins)
+	if (!benchMode && timeSinceLastServerCheckin > timeBetweenServerCheckins)
 		{
 		//	When we check in for this task, we might be told it's redundant
 		
@@ -1182,7 +1343,7 @@ if (++nodesChecked >= nodesBeforeTimeCheck)
 		if (sres==3) cancelledTask=TRUE;
 		};
 
-	if (!splitMode)
+	if (!splitMode && !benchMode)
 		{
 		if (timeSpentOnTask > timeBeforeSplit)
 			{
@@ -1641,6 +1802,7 @@ logString(buffer);
 
 //	Log it with the server
 
+if (!benchMode)
 while (TRUE)
 	{
 	sprintf(buffer,"action=witnessString&n=%u&w=%u&str=%s&team=%s",n,tot_bl,asciiString,teamName);
@@ -1673,6 +1835,7 @@ logString(buffer);
 
 //	Log it with the server
 
+if (!benchMode)
 while (TRUE)
 	{
 	sprintf(buffer,"action=witnessString&n=%u&w=%u&str=%s&team=%s",n,w,asciiString,teamName);
@@ -1805,18 +1968,293 @@ fprintf(fp,"%s %s\n",tsb, s);
 fclose(fp);
 }
 
-//	Get the Instance Count of the server process
+//	Append bytes to the server's response, keeping it null-terminated
 
-#if NO_SERVER || (!USE_SERVER_INSTANCE_COUNTS)
+void appendToResponse(const char *s, size_t len)
+{
+if (serverResponseLen+len+1 > serverResponseSize)
+	{
+	serverResponseSize = 2*(serverResponseLen+len+1);
+	CHECK_MEM( serverResponse = realloc(serverResponse, serverResponseSize*sizeof(char)) )
+	};
+memcpy(serverResponse+serverResponseLen, s, len);
+serverResponseLen += len;
+serverResponse[serverResponseLen] = '\0';
+}
 
-int getServerInstanceCount()
+//	Copy the next line of the server's response, starting from *cursor, into buffer, just as fgets() would read it from a
+//	file, and move *cursor past it.  Returns NULL if there are no more lines.
+
+char *nextResponseLine(char *buffer, int size, const char **cursor)
+{
+const char *s = *cursor;
+if (s==NULL || *s=='\0') return NULL;
+int k=0;
+while (k<size-1 && s[k]!='\0')
+	{
+	buffer[k]=s[k];
+	if (s[k++]=='\n') break;
+	};
+buffer[k]='\0';
+*cursor = s+k;
+return buffer;
+}
+
+//	Put the response to a request for a URL in serverResponse, using the connection for the given channel
+//
+//	Returns non-zero if an error was encountered; an empty response counts as an error making contact, so the caller
+//	should try again later
+
+#if IN_PROCESS_HTTP
+
+int fetchURL(const char *url, int channel)
+{
+static struct httpConnection ownConnection = {-1};
+char host[FILE_NAME_SIZE], port[16];
+const char *path;
+
+serverResponseLen = 0;
+appendToResponse("",0);
+
+if (!parseURL(url,host,sizeof(host),port,sizeof(port),&path))
+	{
+	printf("Error: Unable to use URL %s, which must be of the form http://host[:port]/path\n",url);
+	exit(EXIT_FAILURE);
+	};
+
+//	If we are called while the connection we keep open is in use (because the SIGINT handler is relinquishing the task),
+//	we use a connection of our own
+
+struct httpConnection *hc = connectionBusy[channel] ? &ownConnection : connections+channel;
+if (hc!=&ownConnection) connectionBusy[channel] = TRUE;
+if (hc->fd>=0 && (strcmp(hc->host,host)!=0 || strcmp(hc->port,port)!=0)) httpClose(hc);
+
+//	If the server closed the connection since the last command without our seeing it, the connection is closed or reset
+//	before any of the response arrives, in which case the server never saw the request and it is safe to send it again on
+//	a new connection.  We don't do this if we just timed out, as a slow server might still act on the request.
+
+int res = -1;
+for (int attempt=0;attempt<2;attempt++)
+	{
+	int reused = hc->fd>=0, keepAlive = FALSE;
+	if (!reused && httpConnect(hc,host,port)!=0) break;
+	serverResponseLen = 0;
+	serverResponse[0] = '\0';
+	res = httpGet(hc,path,&keepAlive);
+	if (res!=0 || !keepAlive || hc==&ownConnection) httpClose(hc);
+	if (!(res==-2 && reused)) break;
+	};
+	
+if (hc!=&ownConnection) connectionBusy[channel] = FALSE;
+if (res==0 && serverResponseLen==0) res=-1;
+return res;
+}
+
+//	Split an http:// URL into the host, the port, and the rest, which starts with the path; returns FALSE if the URL is not
+//	of that form
+
+int parseURL(const char *url, char *host, size_t hostSize, char *port, size_t portSize, const char **path)
+{
+const char *scheme = "http://";
+size_t sl = strlen(scheme);
+if (strncmp(url,scheme,sl)!=0) return FALSE;
+
+const char *h = url+sl, *p = strchr(h,'/');
+if (p==NULL) return FALSE;
+const char *colon = memchr(h,':',p-h), *hEnd = colon ? colon : p;
+if (hEnd==h || hEnd-h >= hostSize) return FALSE;
+memcpy(host,h,hEnd-h);
+host[hEnd-h]='\0';
+
+if (colon)
+	{
+	size_t pl = p-colon-1;
+	if (pl==0 || pl>=portSize) return FALSE;
+	memcpy(port,colon+1,pl);
+	port[pl]='\0';
+	}
+else strcpy(port,"80");
+
+*path = p;
+return TRUE;
+}
+
+//	Open a connection to a host; returns non-zero if we could not connect
+
+int httpConnect(struct httpConnection *hc, const char *host, const char *port)
+{
+struct addrinfo hints, *ai0;
+memset(&hints,0,sizeof(hints));
+hints.ai_family = AF_UNSPEC;
+hints.ai_socktype = SOCK_STREAM;
+if (getaddrinfo(host,port,&hints,&ai0)!=0) return -1;
+
+struct timeval tv = {HTTP_TIMEOUT, 0};
+hc->fd = -1;
+for (struct addrinfo *ai=ai0; ai!=NULL; ai=ai->ai_next)
+	{
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd<0) continue;
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+	setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof(tv));
+	if (connect(fd,ai->ai_addr,ai->ai_addrlen)==0)
+		{
+		hc->fd = fd;
+		break;
+		};
+	close(fd);
+	};
+freeaddrinfo(ai0);
+if (hc->fd<0) return -1;
+
+strcpy(hc->host,host);
+strcpy(hc->port,port);
+hc->start = hc->end = 0;
+return 0;
+}
+
+void httpClose(struct httpConnection *hc)
+{
+if (hc->fd>=0) close(hc->fd);
+hc->fd = -1;
+}
+
+//	Receive more bytes into the connection's buffer, which must have none left to deal with.  Returns the number received,
+//	0 if the server has closed the connection, or -1 for an error or a timeout.
+
+ssize_t httpFill(struct httpConnection *hc)
+{
+ssize_t k;
+do k = recv(hc->fd, hc->in, sizeof(hc->in), 0); while (k<0 && errno==EINTR);
+hc->start = 0;
+hc->end = k>0 ? k : 0;
+return k;
+}
+
+//	Read a line of the response header, without the CRLF at the end; anything that doesn't fit in the line is dropped.
+//	Returns FALSE if the connection failed first.
+
+int httpGetLine(struct httpConnection *hc, char *line, size_t size)
+{
+size_t k=0;
+while (TRUE)
+	{
+	if (hc->start==hc->end && httpFill(hc)<=0) return FALSE;
+	char c = hc->in[hc->start++];
+	if (c=='\n') break;
+	if (k+1<size) line[k++]=c;
+	};
+if (k>0 && line[k-1]=='\r') k--;
+line[k]='\0';
+return TRUE;
+}
+
+//	Append the next len bytes of the response body to serverResponse; returns FALSE if the connection failed first
+
+int httpReadBody(struct httpConnection *hc, size_t len)
+{
+while (len>0)
+	{
+	if (hc->start==hc->end && httpFill(hc)<=0) return FALSE;
+	size_t k = hc->end-hc->start;
+	if (k>len) k=len;
+	appendToResponse(hc->in+hc->start,k);
+	hc->start += k;
+	len -= k;
+	};
+return TRUE;
+}
+
+//	Send an HTTP/1.1 GET request on an open connection, and put the body of the response in serverResponse.
+//
+//	Returns 0 if we got a complete response, setting *keepAlive to say whether the server will take another request on the
+//	same connection; -2 if the server closed or reset the connection before any of the response arrived; or -1 for any other
+//	failure, including a timeout.
+
+int httpGet(struct httpConnection *hc, const char *path, int *keepAlive)
 {
+char line[1024];
+size_t len = strlen(path)+strlen(hc->host)+strlen(hc->port)+128;
+char *req;
+CHECK_MEM( req = malloc(len*sizeof(char)) )
+len = sprintf(req,"GET %s HTTP/1.1\r\nHost: %s%s%s\r\nUser-Agent: DistributedChaffinMethod\r\nConnection: keep-alive\r\n\r\n",
+	path,hc->host,strcmp(hc->port,"80")==0 ? "" : ":",strcmp(hc->port,"80")==0 ? "" : hc->port);
+
+for (size_t sent=0; sent<len; )
+	{
+	ssize_t k = send(hc->fd, req+sent, len-sent, 0);
+	if (k<0 && errno==EINTR) continue;
+	if (k<=0)
+		{
+		free(req);
+		return (k<0 && (errno==EPIPE || errno==ECONNRESET)) ? -2 : -1;
+		};
+	sent += k;
+	};
+free(req);
+
+//	Status line, e.g. "HTTP/1.1 200 OK"; as with URL_UTILITY, we take the body whatever the status
+
+hc->start = hc->end = 0;
+ssize_t k = httpFill(hc);
+if (k==0 || (k<0 && errno==ECONNRESET)) return -2;
+if (k<0) return -1;
+if (!httpGetLine(hc,line,sizeof(line)) || strncmp(line,"HTTP/1.",7)!=0) return -1;
+*keepAlive = line[7]=='1';
+
+//	Header fields, up to a blank line
+
+long contentLength = -1;
+int chunked = FALSE;
+while (TRUE)
+	{
+	if (!httpGetLine(hc,line,sizeof(line))) return -1;
+	if (line[0]=='\0') break;
+	if (strncasecmp(line,"Content-Length:",15)==0) contentLength = strtol(line+15,NULL,10);
+	else if (strncasecmp(line,"Transfer-Encoding:",18)==0 && strstr(line+18,"chunked")!=NULL) chunked = TRUE;
+	else if (strncasecmp(line,"Connection:",11)==0)
+		{
+		if (strstr(line+11,"close")!=NULL) *keepAlive = FALSE;
+		else if (strstr(line+11,"eep-alive")!=NULL) *keepAlive = TRUE;
+		};
+	};
+
+//	The body comes in chunks, each preceded by its size in hex and followed by CRLF, ending with an empty one, or has a
+//	given length, or runs on until the server closes the connection
+
+if (chunked)
+	{
+	while (TRUE)
+		{
+		if (!httpGetLine(hc,line,sizeof(line))) return -1;
+		long size = strtol(line,NULL,16);
+		if (size<0) return -1;
+		if (size==0) break;
+		if (!httpReadBody(hc,size) || !httpGetLine(hc,line,sizeof(line))) return -1;
+		};
+	do if (!httpGetLine(hc,line,sizeof(line))) return -1; while (line[0]!='\0');
+	}
+else if (contentLength>=0)
+	{
+	if (!httpReadBody(hc,contentLength)) return -1;
+	}
+else
+	{
+	*keepAlive = FALSE;
+	while (TRUE)
+		{
+		appendToResponse(hc->in+hc->start,hc->end-hc->start);
+		ssize_t k = httpFill(hc);
+		if (k==0) break;
+		if (k<0) return -1;
+		};
+	};
 return 0;
 }
 
 #else
 
-int getServerInstanceCount()
+int fetchURL(const char *url, int channel)
 {
 //	Pre-empty the response file so it does not end up with any misleading content from a previous command if the
 //	current command fails.
@@ -1830,30 +2268,55 @@ if (fp==NULL)
 fclose(fp);
 
 size_t ulen = strlen(URL_UTILITY);
-size_t slen = strlen(IC_URL);
+size_t slen = strlen(url);
 size_t flen = strlen(SERVER_RESPONSE_FILE_NAME);
 size_t len = ulen+slen+flen+10;
 char *cmd;
 CHECK_MEM( cmd = malloc(len*sizeof(char)) )
-sprintf(cmd,"%s \"%s\" > %s",URL_UTILITY,IC_URL,SERVER_RESPONSE_FILE_NAME);
+sprintf(cmd,"%s \"%s\" > %s",URL_UTILITY,url,SERVER_RESPONSE_FILE_NAME);
 int res = system(cmd);
 free(cmd);
-if (res!=0) return 1;
 
-fp = fopen(SERVER_RESPONSE_FILE_NAME,"rt");
+fp = fopen(SERVER_RESPONSE_FILE_NAME,"rb");
 if (fp==NULL)
 	{
-	printf("Error: Unable to read server response file %s (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
+	printf("Error: Unable to open server response file %s to read (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
 	exit(EXIT_FAILURE);
 	};
-if (fscanf(fp,"%d",&res)!=1) res=1;
+static char buffer[BUFFER_SIZE];
+size_t k;
+serverResponseLen = 0;
+appendToResponse("",0);
+while ((k=fread(buffer,sizeof(char),BUFFER_SIZE,fp))>0) appendToResponse(buffer,k);
 fclose(fp);
+
+if (serverResponseLen==0) res=-1;
 return res;
 }
 
 #endif
 
-//	Send a command string via URL_UTILITY to the server at SERVER_URL, putting the response in the file SERVER_RESPONSE_FILE_NAME
+//	Get the Instance Count of the server process
+
+#if NO_SERVER || (!USE_SERVER_INSTANCE_COUNTS)
+
+int getServerInstanceCount()
+{
+return 0;
+}
+
+#else
+
+int getServerInstanceCount()
+{
+int res;
+if (fetchURL(IC_URL,IC_CHANNEL)!=0 || sscanf(serverResponse,"%d",&res)!=1) res=1;
+return res;
+}
+
+#endif
+
+//	Send a command string to the server at serverURL, putting the response in serverResponse
 //
 //	Returns non-zero if an error was encountered 
 
@@ -1881,40 +2344,14 @@ while (TRUE)
 	logString("Waiting for server to be free");
 	sleepForSecs(ic + rand() % VAR_SERVER_WAIT);
 	};
-	
-//	Pre-empty the response file so it does not end up with any misleading content from a previous command if the
-//	current command fails.
 
-FILE *fp = fopen(SERVER_RESPONSE_FILE_NAME,"wt");
-if (fp==NULL)
-	{
-	printf("Error: Unable to write to server response file %s (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
-	exit(EXIT_FAILURE);
-	};
-fclose(fp);
-
-size_t ulen = strlen(URL_UTILITY);
-size_t slen = strlen(SERVER_URL);
+size_t slen = strlen(serverURL);
 size_t clen = strlen(command);
-size_t flen = strlen(SERVER_RESPONSE_FILE_NAME);
-size_t len = ulen+slen+clen+flen+10;
-char *cmd;
-CHECK_MEM( cmd = malloc(len*sizeof(char)) )
-sprintf(cmd,"%s \"%s%s\" > %s",URL_UTILITY,SERVER_URL,command,SERVER_RESPONSE_FILE_NAME);
-int res = system(cmd);
-free(cmd);
-
-//	Check if file is still empty.  If it is, that counts as an error making contact and we need to retry.
-
-fp = fopen(SERVER_RESPONSE_FILE_NAME,"r");
-if (fp==NULL)
-	{
-	printf("Error: Unable to open server response file %s to read (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
-	exit(EXIT_FAILURE);
-	};
-fseek(fp,0,SEEK_END);
-if (ftell(fp)==0) res=-1;
-fclose(fp);
+char *url;
+CHECK_MEM( url = malloc((slen+clen+1)*sizeof(char)) )
+sprintf(url,"%s%s",serverURL,command);
+int res = fetchURL(url,SERVER_CHANNEL);
+free(url);
 
 //	Release local lock on server access, if any
 
@@ -1949,20 +2386,13 @@ int logServerResponse(const char **responseList, int nrl)
 static char buffer[BUFFER_SIZE], lbuffer[BUFFER_SIZE];
 int error=FALSE, wait=FALSE, response=0;
 
-FILE *fp = fopen(SERVER_RESPONSE_FILE_NAME,"rt");
-if (fp==NULL)
-	{
-	printf("Unable to read from server response file %s (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
-	exit(EXIT_FAILURE);
-	};
+const char *cursor = serverResponse;
 
 int lineNumber = 0;
-while (!feof(fp))
+while (nextResponseLine(buffer,BUFFER_SIZE,&cursor)!=NULL)
 	{
 	//	Get a line from the server response, ensure it is null-terminated without a newline
 	
-	char *f=fgets(buffer,BUFFER_SIZE,fp);
-	if (f==NULL) break;
 	size_t blen = strlen(buffer);
 	if (buffer[blen-1]=='\n')
 		{
@@ -1995,7 +2425,6 @@ while (!feof(fp))
 	sprintf(lbuffer,"Server: %s",buffer);
 	logString(lbuffer);
 	};
-fclose(fp);
 	
 if (error) return -2;
 if (wait) return -1;
@@ -2121,12 +2550,7 @@ static char buffer[BUFFER_SIZE];
 sprintf(buffer,"action=getTask&clientID=%u&IP=%s&programInstance=%u&team=%s",clientID,ipAddress,programInstance,teamName);
 sendServerCommandAndLog(buffer,NULL,0);
 
-FILE *fp = fopen(SERVER_RESPONSE_FILE_NAME,"rt");
-if (fp==NULL)
-	{
-	printf("Unable to read from server response file %s (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
-	exit(EXIT_FAILURE);
-	};
+const char *cursor = serverResponse;
 
 int quit=FALSE, taskItems=0;
 static int tif[N_TASK_STRINGS];
@@ -2141,12 +2565,10 @@ tsk->timeBetweenServerCheckins = DEFAULT_TIME_BETWEEN_SERVER_CHECKINS;
 const char *tbsc = "timeBetweenServerCheckins: ";
 size_t tbscL = strlen(tbsc);
 
-while (!feof(fp))
+while (nextResponseLine(buffer,BUFFER_SIZE,&cursor)!=NULL)
 	{
 	//	Get a line from the server response, ensure it is null-terminated without a newline
 	
-	char *f=fgets(buffer,BUFFER_SIZE,fp);
-	if (f==NULL) break;
 	size_t blen = strlen(buffer);
 	if (buffer[blen-1]=='\n')
 		{
@@ -2189,7 +2611,6 @@ while (!feof(fp))
 		};
 		
 	};
-fclose(fp);
 
 if (quit) return -1;
 if (tsk->branchOrderLen != tsk->prefixLen)
@@ -2321,21 +2742,14 @@ while (TRUE)
 	sleepForSecs(timeBetweenServerCheckins);
 	};
 
-FILE *fp = fopen(SERVER_RESPONSE_FILE_NAME,"rt");
-if (fp==NULL)
-	{
-	printf("Unable to read from server response file %s (%s)\n",SERVER_RESPONSE_FILE_NAME, strerror(errno));
-	exit(EXIT_FAILURE);
-	};
+const char *cursor = serverResponse;
 
 int clientItems = 0;
 unsigned int dummyPIN;
-while (!feof(fp))
+while (nextResponseLine(buffer,BUFFER_SIZE,&cursor)!=NULL)
 	{
 	//	Get a line from the server response, ensure it is null-terminated without a newline
 	
-	char *f=fgets(buffer,BUFFER_SIZE,fp);
-	if (f==NULL) break;
 	size_t blen = strlen(buffer);
 	if (buffer[blen-1]=='\n')
 		{
@@ -2379,7 +2793,6 @@ while (!feof(fp))
 			};
 		};
 	};
-fclose(fp);
 
 if (clientItems!=N_CLIENT_STRINGS)
 	{
@@ -2403,6 +2816,8 @@ void unregisterClient()
 {
 char buffer[256];
 
+if (benchMode) return;
+
 sprintf(buffer,
 	"action=unregister&clientID=%u&IP=%s&programInstance=%u",
 		clientID, ipAddress, programInstance);
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+
+"""
+Run fixed workloads on ChaffinMethod and DistributedChaffinMethod, and report the
+nodes searched per second, the wall and CPU time, the peak resident set size and a
+checksum of the results for each one, as JSON.
+
+The node counts and checksums should never change unless the search itself has been
+changed on purpose, so comparing against a baseline (--baseline FILE, a file written
+earlier by this script) catches both broken searches and slowdowns.
+
+Usage: chaffin_bench.py [--repeat R] [--only NAME,...] [--output FILE]
+                        [--baseline FILE] [--max-slowdown FRACTION]
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import platform
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CHAFFIN = os.path.join(ROOT, "ChaffinMethod", "ChaffinMethod")
+DCM = os.path.join(ROOT, "DistributedChaffinMethod", "DistributedChaffinMethod")
+
+CHAFFIN_SUMMARY = re.compile(r"^(\d+) wasted characters: at most (\d+) permutations, in (\d+) characters, (\d+) examples \((\d+) calls\)$")
+DCM_TASK = re.compile(r"Benchmark task \d+: n=(\d+), w=(\d+), prefix=(\d+), nodes=(\d+), .*bestSeenP=(\d+), best=(\d+)$")
+DCM_TOTAL = re.compile(r"Benchmark total: nodes=(\d+),")
+
+# Rises in wall time smaller than this are just timer noise, even for the shortest workloads
+MIN_SLOWDOWN_SECONDS = 0.05
+
+
+def chaffin_results(out, workdir):
+    """
+    The node count is the running total of calls on the last summary line; the checksum
+    covers every summary line and the sorted lists of best strings.
+    """
+    h = hashlib.sha256()
+    nodes = None
+    for line in out.splitlines():
+        m = CHAFFIN_SUMMARY.match(line)
+        if m:
+            h.update(("%s %s %s %s\n" % m.groups()[:4]).encode())
+            nodes = int(m.group(5))
+    names = [f for f in os.listdir(workdir) if re.match(r"Chaffin_\d_W_\d+\.txt$", f)]
+    for name in sorted(names, key=lambda f: int(re.findall(r"\d+", f)[1])):
+        with open(os.path.join(workdir, name)) as f:
+            h.update(name.encode())
+            h.update("".join(sorted(f.readlines())).encode())
+    return nodes, h.hexdigest()
+
+
+def dcm_results(out, workdir):
+    h = hashlib.sha256()
+    nodes = None
+    for line in out.splitlines():
+        m = DCM_TASK.search(line)
+        if m:
+            h.update((" ".join(m.groups()) + "\n").encode())
+        m = DCM_TOTAL.search(line)
+        if m:
+            nodes = int(m.group(1))
+    return nodes, h.hexdigest()
+
+
+WORKLOADS = [
+    ("chaffin_n5", [CHAFFIN, "5", "checkpoint", "0"], chaffin_results),
+    ("chaffin_n6_w40", [CHAFFIN, "6", "lastW", "40", "checkpoint", "0"], chaffin_results),
+    ("chaffin_n6_w80", [CHAFFIN, "6", "lastW", "80", "checkpoint", "0"], chaffin_results),
+    ("dcm_prefixes", [DCM, "bench"], dcm_results),
+]
+
+
+def vm_hwm_kb(pid):
+    """
+    The peak resident set size of a running process, from /proc on Linux, or None.
+    """
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+    except (OSError, ValueError):
+        pass
+    return None
+
+
+def run(cmd, parse):
+    """
+    Run one workload in a fresh directory, so that no earlier output files are picked up.
+    """
+    workdir = tempfile.mkdtemp(prefix="chaffin_bench_")
+    try:
+        with tempfile.TemporaryFile(mode="w+") as out:
+            t0 = time.perf_counter()
+            proc = subprocess.Popen(cmd, cwd=workdir, stdout=out, stderr=subprocess.STDOUT)
+            # ru_maxrss for a child includes the memory of this script at the time it was forked,
+            # so where we can, we follow the peak size of the child's own address space instead
+            hwm = None
+            delay = 0.001
+            while True:
+                hwm = vm_hwm_kb(proc.pid) or hwm
+                pid, status, ru = os.wait4(proc.pid, os.WNOHANG)
+                if pid:
+                    break
+                time.sleep(delay)
+                delay = min(2 * delay, 0.05)
+            wall = time.perf_counter() - t0
+            proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -os.WTERMSIG(status)
+            out.seek(0)
+            text = out.read()
+        if proc.returncode != 0:
+            sys.exit("%s failed with status %d:\n%s" % (" ".join(cmd), proc.returncode, text[-2000:]))
+        nodes, checksum = parse(text, workdir)
+        if nodes is None:
+            sys.exit("%s: no node count found in the output" % " ".join(cmd))
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    # ru_maxrss is in kilobytes on Linux, but in bytes on macOS
+    rss_kb = hwm or (ru.ru_maxrss // 1024 if sys.platform == "darwin" else ru.ru_maxrss)
+    return {
+        "wall_seconds": round(wall, 3),
+        "cpu_seconds": round(ru.ru_utime + ru.ru_stime, 3),
+        "peak_rss_kb": rss_kb,
+        "nodes": nodes,
+        "nodes_per_second": round(nodes / wall) if wall > 0 else 0,
+        "checksum": checksum,
+    }
+
+
+def compare(results, baseline, max_slowdown):
+    """
+    Return a list of problems found by comparing results with a baseline.
+    """
+    problems = []
+    old = {w["name"]: w for w in baseline["workloads"]}
+    for w in results["workloads"]:
+        b = old.get(w["name"])
+        if b is None:
+            continue
+        if w["checksum"] != b["checksum"]:
+            problems.append("%s: checksum changed from %s to %s" % (w["name"], b["checksum"], w["checksum"]))
+        if w["nodes"] != b["nodes"]:
+            problems.append("%s: node count changed from %d to %d" % (w["name"], b["nodes"], w["nodes"]))
+        elif w["wall_seconds"] > b["wall_seconds"] * (1 + max_slowdown) + MIN_SLOWDOWN_SECONDS:
+            problems.append("%s: wall time rose from %.3f to %.3f seconds" % (w["name"], b["wall_seconds"], w["wall_seconds"]))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fixed-workload benchmarks for the Chaffin search engines.")
+    parser.add_argument("--repeat", type=int, default=1, help="runs of each workload; the fastest is reported")
+    parser.add_argument("--only", help="comma-separated names of the workloads to run")
+    parser.add_argument("--output", help="file to write the JSON to, as well as standard output")
+    parser.add_argument("--baseline", help="JSON from an earlier run to compare against")
+    parser.add_argument("--max-slowdown", type=float, default=0.15,
+                        help="fractional rise in wall time over the baseline treated as a regression (default 0.15)")
+    args = parser.parse_args()
+
+    names = args.only.split(",") if args.only else [w[0] for w in WORKLOADS]
+    unknown = set(names) - set(w[0] for w in WORKLOADS)
+    if unknown:
+        sys.exit("Unknown workloads: %s" % ", ".join(sorted(unknown)))
+
+    results = {
+        "host": platform.node(),
+        "machine": platform.machine(),
+        "cpus": os.cpu_count(),
+        "workloads": [],
+    }
+    for name, cmd, parse in WORKLOADS:
+        if name not in names:
+            continue
+        if not os.access(cmd[0], os.X_OK):
+            sys.exit("%s has not been built" % cmd[0])
+        runs = [run(cmd, parse) for _ in range(max(1, args.repeat))]
+        for r in runs[1:]:
+            if (r["nodes"], r["checksum"]) != (runs[0]["nodes"], runs[0]["checksum"]):
+                sys.exit("%s gave different results on different runs" % name)
+        best = min(runs, key=lambda r: r["wall_seconds"])
+        best["peak_rss_kb"] = max(r["peak_rss_kb"] for r in runs)
+        results["workloads"].append(dict(name=name, command=" ".join([os.path.basename(cmd[0])] + cmd[1:]), **best))
+        print("%-16s %8.3f s  %12d nodes/s  %8d KB" % (name, best["wall_seconds"], best["nodes_per_second"], best["peak_rss_kb"]),
+              file=sys.stderr)
+
+    text = json.dumps(results, indent=2)
+    print(text)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            problems = compare(results, json.load(f), args.max_slowdown)
+        for p in problems:
+            print("REGRESSION: " + p, file=sys.stderr)
+        if problems:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+
+"""
+Check ChaffinMethod's "noMirrors" option against a run without it.
+
+For each n, this runs ChaffinMethod to completion twice in scratch directories, once
+plainly and once with noMirrors, and checks that both produce the same set of W files,
+that each text file holds the same strings once sorted, that the packed .bin files are
+written for the same w values, and that the summary lines agree.
+
+Usage: chaffin_mirror_test.py [--n N,...] [PROGRAM]
+"""
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CM = os.path.join(ROOT, "ChaffinMethod", "ChaffinMethod")
+
+SUMMARY = re.compile(r"^(\d+ wasted characters: .* examples)", re.M)
+
+
+def run(program, n, extra):
+    d = tempfile.mkdtemp(prefix="chaffin_mirror_")
+    out = subprocess.run([program, str(n)] + extra, cwd=d, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT, universal_newlines=True, check=True).stdout
+    return d, out
+
+
+def wFiles(d, n, ext):
+    return {os.path.basename(f) for f in glob.glob(os.path.join(d, "Chaffin_%d_W_*%s" % (n, ext)))}
+
+
+def sortedLines(path):
+    with open(path) as f:
+        return sorted(f.read().split())
+
+
+def check(program, n):
+    errors = []
+    plain, plainOut = run(program, n, [])
+    mirrors, mirrorsOut = run(program, n, ["noMirrors"])
+    try:
+        if SUMMARY.findall(plainOut) != SUMMARY.findall(mirrorsOut):
+            errors.append("summary lines differ")
+        for ext in (".txt", ".bin"):
+            a, b = wFiles(plain, n, ext), wFiles(mirrors, n, ext)
+            if a != b:
+                errors.append("%s files differ: %s" % (ext, " ".join(sorted(a ^ b))))
+        txt = sorted(wFiles(plain, n, ".txt") & wFiles(mirrors, n, ".txt"))
+        for name in txt:
+            if sortedLines(os.path.join(plain, name)) != sortedLines(os.path.join(mirrors, name)):
+                errors.append("%s differs" % name)
+        print("n=%d: %d text files compared, %s" % (n, len(txt), "OK" if not errors else "FAILED"))
+        for e in errors:
+            print("  " + e)
+    finally:
+        shutil.rmtree(plain)
+        shutil.rmtree(mirrors)
+    return not errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("--n", default="4,5", help="comma-separated values of n (default 4,5)")
+    parser.add_argument("program", nargs="?", default=CM)
+    args = parser.parse_args()
+
+    ok = True
+    for n in args.n.split(","):
+        ok = check(args.program, int(n)) and ok
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
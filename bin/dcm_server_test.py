@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+
+"""
+Run DistributedChaffinMethod against a stand-in for the server on localhost, to check
+the program's own HTTP client.
+
+For each way the stand-in can answer (with a Content-Length, in chunks, by closing the
+connection after each response, or by claiming to keep the connection open but then
+dropping it), this runs the program's "test" mode, then a whole session: hello,
+register, one short task, and a Quit instruction.  It checks that every command
+arrives exactly once, that a kept connection is reused for the whole session, and that
+after a dropped connection each command is sent again on a new one.
+
+Usage: dcm_server_test.py [--only MODE,...] [PROGRAM]
+"""
+
+import argparse
+import os
+import shutil
+import socket
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import urllib.parse
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DCM = os.path.join(ROOT, "DistributedChaffinMethod", "DistributedChaffinMethod")
+
+MODES = ["length", "chunked", "close", "drop"]
+
+# A task that takes well under a second: the known maximum for n=5, w=28 is 118
+TASK = ("Task id: 1\nAccess code: 99\nn: 5\nw: 28\nstr: 12345\npte: 117\npro: 120\nbranchOrder: 00000\n"
+        "timeBeforeSplit: 1000\nmaxTimeInSubtree: 1000\ntimeBetweenServerCheckins: 1\n")
+
+TIMEOUT = 120
+
+
+class StandIn(socketserver.ThreadingTCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, mode):
+        super().__init__(("127.0.0.1", 0), Handler)
+        self.mode = mode
+        self.lock = threading.Lock()
+        self.connections = 0
+        self.actions = []
+        self.tasksGiven = 0
+
+    def respond(self, query):
+        """
+        The body of the response to a command, as the real server would send it.
+        """
+        q = urllib.parse.parse_qs(query)
+        action = q.get("action", [""])[0]
+        with self.lock:
+            self.actions.append(action)
+            if action == "hello":
+                return "Hello world.\n"
+            if action == "register":
+                return "Registered\nClient id: 7\nIP: 127.0.0.1\nprogramInstance: %s\n" % q["programInstance"][0]
+            if action == "getTask":
+                self.tasksGiven += 1
+                return TASK if self.tasksGiven == 1 else "Quit\n"
+            if action == "witnessString":
+                return "Valid string\n"
+            return "OK\n"
+
+
+class Handler(socketserver.StreamRequestHandler):
+    def handle(self):
+        server = self.server
+        with server.lock:
+            server.connections += 1
+        while True:
+            line = self.rfile.readline()
+            if not line:
+                return
+            target = line.split()[1].decode()
+            while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                pass
+            body = server.respond(urllib.parse.urlsplit(target).query).encode()
+
+            if server.mode == "chunked":
+                half = len(body) // 2
+                out = (b"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                       + b"%x\r\n%s\r\n" % (half, body[:half])
+                       + b"%x;ext=1\r\n%s\r\n" % (len(body) - half, body[half:])
+                       + b"0\r\nX-Trailer: ignored\r\n\r\n")
+            elif server.mode == "close":
+                out = b"HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\n" + body
+            else:
+                out = b"HTTP/1.1 200 OK\r\nContent-Length: %d\r\nKeep-Alive: timeout=5\r\n\r\n%s" % (len(body), body)
+            self.wfile.write(out)
+            self.wfile.flush()
+
+            # In "drop" mode we say nothing about closing, so the client will try to reuse the connection
+            if server.mode in ("close", "drop"):
+                self.connection.shutdown(socket.SHUT_RDWR)
+                return
+
+
+def run_client(program, args, workdir):
+    proc = subprocess.run([program] + args, cwd=workdir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          text=True, timeout=TIMEOUT)
+    return proc.returncode, proc.stdout
+
+
+def check_mode(program, mode):
+    """
+    Return a list of problems found with one way of answering.
+    """
+    problems = []
+    workdir = tempfile.mkdtemp(prefix="dcm_server_test_")
+    server = StandIn(mode)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    url = "http://127.0.0.1:%d/ChaffinMethod.php?version=13&" % server.server_address[1]
+    try:
+        status, out = run_client(program, ["test", "server", url], workdir)
+        if status != 0 or "Server: Hello world." not in out:
+            problems.append("test mode failed with status %d:\n%s" % (status, out[-2000:]))
+        server.actions = []
+        server.connections = 0
+
+        status, out = run_client(program, ["server", url], workdir)
+        actions = server.actions
+        if status != 0 or "Quit instruction from server" not in out:
+            problems.append("session failed with status %d:\n%s" % (status, out[-2000:]))
+        expected = ["hello", "register", "getTask"]
+        if actions[:3] != expected or actions[-2:] != ["finishTask", "getTask"]:
+            problems.append("unexpected commands: %s" % ", ".join(actions))
+        repeated = [a for a in set(actions) if a != "getTask" and actions.count(a) > 1]
+        if repeated or actions.count("getTask") != 2:
+            problems.append("commands sent more than once: %s" % ", ".join(actions))
+        wanted = 1 if mode in ("length", "chunked") else len(actions)
+        if server.connections != wanted:
+            problems.append("%d connections for %d commands, expected %d" % (server.connections, len(actions), wanted))
+        leftovers = [f for f in os.listdir(workdir) if f.startswith("DCMServerResponse_")]
+        if leftovers:
+            problems.append("response files written: %s" % ", ".join(leftovers))
+        print("%-8s %2d commands, %2d connections%s" % (mode, len(actions), server.connections,
+                                                        "" if not problems else ", FAILED"), file=sys.stderr)
+    except subprocess.TimeoutExpired:
+        problems.append("client did not finish within %d seconds" % TIMEOUT)
+    finally:
+        server.shutdown()
+        server.server_close()
+        shutil.rmtree(workdir, ignore_errors=True)
+    return ["%s: %s" % (mode, p) for p in problems]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Test DistributedChaffinMethod against a stand-in server.")
+    parser.add_argument("--only", help="comma-separated ways for the server to answer: " + ", ".join(MODES))
+    parser.add_argument("program", nargs="?", default=DCM, help="the program to test (default: the one built in the tree)")
+    args = parser.parse_args()
+
+    modes = args.only.split(",") if args.only else MODES
+    unknown = set(modes) - set(MODES)
+    if unknown:
+        sys.exit("Unknown modes: %s" % ", ".join(sorted(unknown)))
+    if not os.access(args.program, os.X_OK):
+        sys.exit("%s has not been built" % args.program)
+
+    problems = []
+    for mode in modes:
+        problems += check_mode(args.program, mode)
+    for p in problems:
+        print("FAILED: " + p, file=sys.stderr)
+    if problems:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()